@@ -55,8 +55,10 @@ Console::Console(char *readFile, char *writeFile, VoidFunctionPtr readAvail,
     putBusy = FALSE;
     incoming = EOF;
 
-    // start polling for incoming packets
+    // start polling for incoming packets; when there is nothing else
+    // to do, wait for them
     interrupt->Schedule(ConsoleReadPoll, (int)this, ConsoleTime, ConsoleReadInt);
+    interrupt->WaitOnIdle(readFileNo);
 }
 
 //----------------------------------------------------------------------
@@ -30,7 +30,8 @@ using namespace std;
 #include <iostream>
 static char *intLevelNames[] = { "off", "on"};
 static char *intTypeNames[] = { "timer", "disk", "console write", 
-			"console read", "network send", "network recv"};
+			"console read", "network send", "network recv",
+			"network timer"};
 using namespace std;
 //----------------------------------------------------------------------
 // PendingInterrupt::PendingInterrupt
@@ -52,6 +53,37 @@ PendingInterrupt::PendingInterrupt(VoidFunctionPtr func, int param, int64_t time
     type = kind;
 }
 
+//----------------------------------------------------------------------
+// PendingInterrupt::operator new, operator delete
+// 	Allocate PendingInterrupts from a free list of previously used
+//	ones, going to the heap only when the free list is empty.
+//----------------------------------------------------------------------
+
+PendingInterrupt *PendingInterrupt::freeList = NULL;
+
+void *
+PendingInterrupt::operator new(size_t size)
+{
+    PendingInterrupt *pend = freeList;
+
+    ASSERT(size == sizeof(PendingInterrupt));
+    if (pend == NULL)
+	return ::operator new(size);
+    freeList = pend->nextFree;
+    return (void *) pend;
+}
+
+void
+PendingInterrupt::operator delete(void *ptr)
+{
+    PendingInterrupt *pend = (PendingInterrupt *) ptr;
+
+    if (pend == NULL)
+	return;
+    pend->nextFree = freeList;
+    freeList = pend;
+}
+
 //----------------------------------------------------------------------
 // Interrupt::Interrupt
 // 	Initialize the simulation of hardware device interrupts.
@@ -62,10 +94,14 @@ PendingInterrupt::PendingInterrupt(VoidFunctionPtr func, int param, int64_t time
 Interrupt::Interrupt()
 {
     level = IntOff;
-    pending = new List();
+    maxPending = 64;
+    pending = new PendingInterrupt *[maxPending];
+    numPending = 0;
+    numScheduled = 0;
     inHandler = FALSE;
     yieldOnReturn = FALSE;
     status = SystemMode;
+    numIdleFiles = 0;
 }
 
 //----------------------------------------------------------------------
@@ -75,9 +111,9 @@ Interrupt::Interrupt()
 
 Interrupt::~Interrupt()
 {
-    while (!pending->IsEmpty())
-	delete (PendingInterrupt *) pending->Remove();
-    delete pending;
+    while (numPending > 0)
+	delete HeapRemove();
+    delete [] pending;
 }
 
 //----------------------------------------------------------------------
@@ -222,6 +258,14 @@ Interrupt::Idle()
 {
     DEBUG('i', "Machine idling; checking for interrupts.\n");
     status = IdleMode;
+
+    // if all we would do is keep polling the devices for input, don't:
+    // wait on the host until there is some input, and then poll
+    if (numIdleFiles > 0 && OnlyPollsPending()) {
+	DEBUG('i', "Machine idle.  Waiting for input.\n");
+	WaitForFiles(idleFiles, numIdleFiles);
+    }
+
     if (CheckIfDue(TRUE)) {		// check for any pending interrupts
     	while (CheckIfDue(FALSE))	// check for any other pending 
 	    ;				// interrupts
@@ -243,6 +287,35 @@ Interrupt::Idle()
     Halt();
 }
 
+//----------------------------------------------------------------------
+// Interrupt::WaitOnIdle
+// 	Record the host file that a polled input device (the console or
+//	the network) reads, so that Idle can wait on it.
+//----------------------------------------------------------------------
+void
+Interrupt::WaitOnIdle(int fd)
+{
+    ASSERT(numIdleFiles < MaxIdleFiles);
+    idleFiles[numIdleFiles++] = fd;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::OnlyPollsPending
+// 	Return TRUE if every pending interrupt is either an input device
+//	polling for input or the time-slice timer, neither of which will
+//	make a thread runnable unless some input arrives.
+//----------------------------------------------------------------------
+bool
+Interrupt::OnlyPollsPending()
+{
+    for (int i = 0; i < numPending; i++)
+	if (pending[i]->type != ConsoleReadInt && 
+		pending[i]->type != NetworkRecvInt && 
+		pending[i]->type != TimerInt)
+	    return FALSE;
+    return TRUE;
+}
+
 //----------------------------------------------------------------------
 // Interrupt::Halt
 // 	Shut down Nachos cleanly, printing out performance statistics.
@@ -260,7 +333,8 @@ Interrupt::Halt()
 // 	Arrange for the CPU to be interrupted when simulated time
 //	reaches "now + when".
 //
-//	Implementation: just put it on a sorted list.
+//	Implementation: put it on the min-heap of pending interrupts,
+//	which costs O(log n) rather than a walk down a sorted list.
 //
 //	NOTE: the Nachos kernel should not call this routine directly.
 //	Instead, it is only called by the hardware device simulators.
@@ -277,13 +351,86 @@ Interrupt::Schedule(VoidFunctionPtr handler, int arg, int64_t fromNow, IntType t
     int64_t when = stats->totalTicks + fromNow;
     PendingInterrupt *toOccur = new PendingInterrupt(handler, arg, when, type);
 
+    toOccur->order = numScheduled++;
+
     //DEBUG('i', "Scheduling interrupt handler the %s at time = %d\n", 
 	//				intTypeNames[type], when);
     if(DebugIsEnabled('i'))
         cout << "Scheduling interrupt handler the " << intTypeNames[type] << " at time = " << hex << when << endl;
     ASSERT(fromNow > 0);
 
-    pending->SortedInsert(toOccur, when);
+    HeapInsert(toOccur);
+}
+
+//----------------------------------------------------------------------
+// Interrupt::Earlier
+// 	Return TRUE if interrupt "a" should fire before interrupt "b".
+//	Interrupts due at the same time fire in the order they were
+//	scheduled, just as they did when "pending" was a sorted list.
+//----------------------------------------------------------------------
+
+bool
+Interrupt::Earlier(PendingInterrupt *a, PendingInterrupt *b)
+{
+    if (a->when != b->when)
+	return a->when < b->when;
+    return a->order < b->order;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::HeapInsert
+// 	Add an interrupt to the heap, growing the array if it is full,
+//	and sift it up to its place.
+//----------------------------------------------------------------------
+
+void
+Interrupt::HeapInsert(PendingInterrupt *toOccur)
+{
+    int i, parent;
+
+    if (numPending == maxPending) {
+	PendingInterrupt **bigger = new PendingInterrupt *[maxPending * 2];
+	for (i = 0; i < numPending; i++)
+	    bigger[i] = pending[i];
+	delete [] pending;
+	pending = bigger;
+	maxPending *= 2;
+    }
+
+    for (i = numPending++; i > 0; i = parent) {
+	parent = (i - 1) / 2;
+	if (!Earlier(toOccur, pending[parent]))
+	    break;
+	pending[i] = pending[parent];
+    }
+    pending[i] = toOccur;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::HeapRemove
+// 	Remove and return the earliest pending interrupt, or NULL if
+//	there are none.  The last entry is sifted down into the hole.
+//----------------------------------------------------------------------
+
+PendingInterrupt *
+Interrupt::HeapRemove()
+{
+    PendingInterrupt *first, *moving;
+    int i, child;
+
+    if (numPending == 0)
+	return NULL;
+    first = pending[0];
+    moving = pending[--numPending];
+    for (i = 0; (child = 2 * i + 1) < numPending; i = child) {
+	if (child + 1 < numPending && Earlier(pending[child + 1], pending[child]))
+	    child++;
+	if (!Earlier(pending[child], moving))
+	    break;
+	pending[i] = pending[child];
+    }
+    pending[i] = moving;
+    return first;
 }
 
 //----------------------------------------------------------------------
@@ -314,11 +461,17 @@ Interrupt::CheckIfDue(bool advanceClock)
     if (DebugIsEnabled('i'))
 	    DumpState();
     
-    PendingInterrupt *toOccur = (PendingInterrupt *)pending->SortedRemove(&when);
-
-    if (toOccur == NULL)		// no pending interrupts
+    if (numPending == 0)		// no pending interrupts
 	return FALSE;			
 
+    // look at the earliest interrupt without taking it off the heap,
+    // so that there's nothing to put back if it isn't due yet
+    PendingInterrupt *toOccur = pending[0];
+    when = toOccur->when;
+
+    if (!advanceClock && when > stats->totalTicks) 
+	return FALSE;			// not time yet
+
     if (advanceClock ) 
     {	// advance the clock
         if(when > stats->totalTicks)
@@ -326,18 +479,14 @@ Interrupt::CheckIfDue(bool advanceClock)
 	        stats->idleTicks += (when - stats->totalTicks);
 	        stats->totalTicks = when;
         }
-    } else if (when > stats->totalTicks) 
-    {	// not time yet, put it back
-	    pending->SortedInsert(toOccur, when);
-	    return FALSE;
     }
 
 // Check if there is nothing more to do, and if so, quit
     if ((status == IdleMode) && (toOccur->type == TimerInt) 
-				&& pending->IsEmpty()) {
-	 pending->SortedInsert(toOccur, when);
+				&& numPending == 1)
 	 return FALSE;
-    }
+
+    (void) HeapRemove();
 
     //DEBUG('i', "Invoking interrupt handler for the %s at time %d\n", 
 	//		intTypeNames[toOccur->type], toOccur->when);
@@ -386,7 +535,8 @@ Interrupt::DumpState()
     //printf("Time: %d, interrupts %s\n", stats->totalTicks, intLevelNames[level]);
     printf("Pending interrupts:\n");
     fflush(stdout);
-    pending->Mapcar(PrintPending);
+    for (int i = 0; i < numPending; i++)	// in heap order, not sorted
+	PrintPending((int) pending[i]);
     printf("End of pending interrupts\n");
     fflush(stdout);
 }
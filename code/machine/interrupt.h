@@ -48,27 +48,43 @@ enum MachineStatus {IdleMode, SystemMode, UserMode};
 
 // IntType records which hardware device generated an interrupt.
 // In Nachos, we support a hardware timer device, a disk, a console
-// display and keyboard, and a network.
+// display and keyboard, and a network.  NetworkTimerInt is the post
+// office's retransmit timer.
 enum IntType { TimerInt, DiskInt, ConsoleWriteInt, ConsoleReadInt, 
-				NetworkSendInt, NetworkRecvInt};
+				NetworkSendInt, NetworkRecvInt, NetworkTimerInt};
 
 // The following class defines an interrupt that is scheduled
 // to occur in the future.  The internal data structures are
 // left public to make it simpler to manipulate.
 
+//
+// PendingInterrupts are allocated from a pool, since the device
+// simulators schedule one for nearly every tick of work they do.
+
 class PendingInterrupt {
   public:
     PendingInterrupt(VoidFunctionPtr func, int param, int64_t time, IntType kind);
 				// initialize an interrupt that will
 				// occur in the future
 
+    void *operator new(size_t size);	// take one from the pool
+    void operator delete(void *ptr);	// put one back in the pool
+
     VoidFunctionPtr handler;    // The function (in the hardware device
 				// emulator) to call when the interrupt occurs
     int arg;                    // The argument to the function.
     int64_t when;			// When the interrupt is supposed to fire
     IntType type;		// for debugging
+    int64_t order;		// when it was scheduled, so that interrupts
+				// due at the same time fire in FIFO order
+
+  private:
+    PendingInterrupt *nextFree;	// link on the pool's free list
+    static PendingInterrupt *freeList;
 };
 
+#define MaxIdleFiles	4	// host files Idle can wait on
+
 // The following class defines the data structures for the simulation
 // of hardware interrupts.  We record whether interrupts are enabled
 // or disabled, and any hardware interrupts that are scheduled to occur
@@ -112,22 +128,39 @@ class Interrupt {
     
     void OneTick();       		// Advance simulated time
 
+    void WaitOnIdle(int fd);		// When idle with nothing to do but
+					// poll for input, wait for some
+					// to arrive on "fd"
+
   private:
     IntStatus level;		// are interrupts enabled or disabled?
-    List *pending;		// the list of interrupts scheduled
-				// to occur in the future
+    PendingInterrupt **pending;	// the interrupts scheduled to occur
+				// in the future, kept as a binary 
+				// min-heap on (when, order)
+    int numPending;		// number of entries in "pending"
+    int maxPending;		// size of the "pending" array
+    int64_t numScheduled;	// interrupts scheduled so far
     bool inHandler;		// TRUE if we are running an interrupt handler
     bool yieldOnReturn; 	// TRUE if we are to context switch
 				// on return from the interrupt handler
     MachineStatus status;	// idle, kernel mode, user mode
+    int idleFiles[MaxIdleFiles]; // host files the polled devices read
+    int numIdleFiles;
 
     // these functions are internal to the interrupt simulation code
 
     bool CheckIfDue(bool advanceClock); // Check if an interrupt is supposed
 					// to occur now
+    bool OnlyPollsPending();		// Is every pending interrupt a
+					// device polling for input?
 
     void ChangeLevel(IntStatus old, 	// SetLevel, without advancing the
 	IntStatus now);  		// simulated time
+
+    // min-heap of pending interrupts
+    bool Earlier(PendingInterrupt *a, PendingInterrupt *b);
+    void HeapInsert(PendingInterrupt *toOccur);
+    PendingInterrupt *HeapRemove();	// take off the earliest interrupt
 };
 
 #endif // INTERRRUPT_H
@@ -68,6 +68,7 @@ Machine::Machine(bool debug)
       lastUsed[i] = stats->totalTicks;
     }
 
+    currentAsid = 0;
 #ifdef USE_TLB
     tlb = new TranslationEntry[TLBSize];
     for (i = 0; i < TLBSize; i++)
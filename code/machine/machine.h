@@ -183,6 +183,10 @@ class Machine {
 
     TranslationEntry *pageTable;
     unsigned int pageTableSize;
+    int currentAsid;			// id of the running address space;
+					// TLB entries tagged with any other
+					// id are ignored, so the TLB doesn't
+					// have to be flushed on a switch
 
    int getTimeUsed( int pageNo );
 
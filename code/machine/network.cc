@@ -15,6 +15,23 @@ extern "C" {
 	int bcopy(char *, char *, int);
 };
 
+// One ring of the shared memory transport.  "head" is written only by
+// the machine the ring belongs to and "tail" only by the machine sending 
+// to it; they are on separate cache lines so that the two don't fight 
+// over one.
+struct PacketRing {
+    volatile unsigned int head;		// next packet to take out
+    char pad1[60];
+    volatile unsigned int tail;		// next slot to put a packet in
+    char pad2[60];
+    char packets[RingPackets][MaxWireSize];
+};
+
+#define RingFileSize	(MaxRingMachines * sizeof(struct PacketRing))
+
+// The ring in "file" for packets from "from"
+#define RingFrom(file, from)	((PacketRing *) (file) + (from))
+
 // Dummy functions because C++ can't call member functions indirectly 
 static void NetworkReadPoll(int arg)
 { Network *net = (Network *)arg; net->CheckPktAvail(); }
@@ -38,53 +55,157 @@ Network::Network(NetworkAddress addr, double reliability,
     readHandler = readAvail;
     handlerArg = callArg;
     sendBusy = FALSE;
-    inHdr.length = 0;
+    firstIn = numIn = 0;
     
     sock = OpenSocket();
     sprintf(sockName, "SOCKET_%d", (int)addr);
     AssignNameToSocket(sockName, sock);		 // Bind socket to a filename 
 						 // in the current directory.
 
-    // start polling for incoming packets
+    sharedMemory = sharedMemoryNetwork;
+    inRings = NULL;
+    nextRing = 0;
+    for (int i = 0; i < MaxRingMachines; i++)
+	outRings[i] = NULL;
+    if (sharedMemory) {
+	char ringName[32];
+
+	ASSERT((addr >= 0) && (addr < MaxRingMachines));
+	sprintf(ringName, "RING_%d", (int)addr);
+	inRings = OpenSharedFile(ringName, RingFileSize, TRUE);
+	ASSERT(inRings != NULL);
+    }
+
+    // start polling for incoming packets; when there is nothing else
+    // to do, wait for them
     interrupt->Schedule(NetworkReadPoll, (int)this, NetworkTime, NetworkRecvInt);
+    interrupt->WaitOnIdle(sock);
 }
 
 Network::~Network()
 {
     CloseSocket(sock);
     DeAssignNameToSocket(sockName);
+    if (inRings != NULL) {
+	char ringName[32];
+
+	// machines that already have it mapped can keep using it
+	CloseSharedFile(inRings, RingFileSize);
+	sprintf(ringName, "RING_%d", (int)ident);
+	Unlink(ringName);
+    }
+    for (int i = 0; i < MaxRingMachines; i++)
+	if (outRings[i] != NULL)
+	    CloseSharedFile(outRings[i], RingFileSize);
+}
+
+// take the next packet off the wire, if there is one: from the socket,
+// or from whichever ring is next in turn and not empty
+bool
+Network::ReadPacket(char *buffer)
+{
+    if (!sharedMemory)
+	return TryReadFromSocket(sock, buffer, MaxWireSize);
+
+    for (int i = 0; i < MaxRingMachines; i++) {
+	PacketRing *ring = RingFrom(inRings, nextRing);
+
+	nextRing = (nextRing + 1) % MaxRingMachines;
+	if (ring->head != ring->tail) {
+	    bcopy(ring->packets[ring->head % RingPackets], buffer, 
+				MaxWireSize);
+	    MemoryBarrier();		// finish reading before freeing it
+	    ring->head++;
+	    return TRUE;
+	}
+    }
+    return FALSE;
+}
+
+// put a packet in our ring in "to"'s file.  If the ring is full, the
+// packet is lost, as if "to" hadn't read it in time.
+bool
+Network::PutInRing(NetworkAddress to, char *buffer)
+{
+    PacketRing *ring;
+    unsigned int tail;
+    char toName[32];
+
+    if ((to < 0) || (to >= MaxRingMachines))
+	return false;
+    if (outRings[to] == NULL) {
+	sprintf(toName, "RING_%d", (int)to);
+	outRings[to] = OpenSharedFile(toName, RingFileSize, FALSE);
+	if (outRings[to] == NULL)	// it hasn't started yet
+	    return false;
+    }
+    ring = RingFrom(outRings[to], ident);
+    tail = ring->tail;
+    if (tail - ring->head == RingPackets) {
+	DEBUG('n', "ring full, lost it!\n");
+	return true;
+    }
+    bcopy(buffer, ring->packets[tail % RingPackets], MaxWireSize);
+    MemoryBarrier();			// finish writing before publishing it
+    ring->tail = tail + 1;
+    MemoryBarrier();			// publish it before looking at head
+
+    // if "to" had already taken everything else out, it may be about to
+    // wait for a packet: wake it up
+    if (ring->head == tail)
+	RingDoorbell(to);
+    return true;
 }
 
-// if a packet is already buffered, we simply delay reading 
-// the incoming packet.  In real life, the incoming 
-// packet might be dropped if we can't read it in time.
+// send a one byte message, which "to" throws away, to wake it up
+void
+Network::RingDoorbell(NetworkAddress to)
+{
+    char toName[32];
+    char bell = 0;
+
+    sprintf(toName, "SOCKET_%d", (int)to);
+    (void) SendToSocket(sock, &bell, 1, toName);
+}
+
+// read in every packet that has arrived, as long as there is room to
+// buffer it, so that a burst of packets is taken in one poll rather than
+// one per poll.  If the buffer is full, we simply delay reading 
+// the incoming packets.  In real life, they might be dropped if we 
+// can't read them in time.
 void
 Network::CheckPktAvail()
 {
+    char buffer[MaxWireSize];
+
     // schedule the next time to poll for a packet
     interrupt->Schedule(NetworkReadPoll, (int)this, NetworkTime, NetworkRecvInt);
 
-    if (inHdr.length != 0) 	// do nothing if packet is already buffered
-	    return;		
-    if (!PollSocket(sock)) 	// do nothing if no packet to be read
-	    return;
-    //cout << "Network::CheckPktAvail(): stats->totalTicks = " << stats->totalTicks << endl;
-    // otherwise, read packet in
-    char *buffer = new char[MaxWireSize];
-    ReadFromSocket(sock, buffer, MaxWireSize);
+    if (sharedMemory)
+	ClearSocket(sock);	// the doorbells have done their job
 
-    // divide packet into header and data
-    inHdr = *(PacketHeader *)buffer;
-    ASSERT((inHdr.to == ident) && (inHdr.length <= MaxPacketSize));
-    bcopy(buffer + sizeof(PacketHeader), inbox, inHdr.length);
-    delete []buffer ;
+    while (numIn < NetworkBufferPackets && ReadPacket(buffer)) {
+	int slot = (firstIn + numIn) % NetworkBufferPackets;
 
-    DEBUG('n', "Network received packet from %d, length %d...\n",
-	  				(int) inHdr.from, inHdr.length);
-    stats->numPacketsRecvd++;
+	// divide packet into header and data
+	inHdr[slot] = *(PacketHeader *)buffer;
+	ASSERT((inHdr[slot].to == ident) 
+		&& (inHdr[slot].length <= MaxPacketSize));
+	bcopy(buffer + sizeof(PacketHeader), inbox[slot], inHdr[slot].length);
+	numIn++;
 
-    // tell post office that the packet has arrived
-    (*readHandler)(handlerArg);	
+	DEBUG('n', "Network received packet from %d, length %d...\n",
+	  			(int) inHdr[slot].from, inHdr[slot].length);
+	stats->numPacketsRecvd++;
+
+	// tell post office that the packet has arrived
+	(*readHandler)(handlerArg);	
+    }
+
+    // if we had to leave packets in the rings, don't let Idle wait for
+    // a doorbell that won't come
+    if (sharedMemory && numIn == NetworkBufferPackets)
+	RingDoorbell(ident);
 }
 
 // notify user that another packet can be sent
@@ -123,20 +244,29 @@ Network::Send(PacketHeader hdr, char* data)
     char *buffer = new char[MaxWireSize];
     *(PacketHeader *)buffer = hdr;
     bcopy(data, buffer + sizeof(PacketHeader), hdr.length);
-    int retVal = SendToSocket(sock, buffer, MaxWireSize, toName);
+    int retVal;
+    if (sharedMemory)
+	retVal = PutInRing(hdr.to, buffer);
+    else
+	retVal = SendToSocket(sock, buffer, MaxWireSize, toName);
     delete []buffer;
 
     return retVal;
 }
 
-// read a packet, if one is buffered
+// read the oldest packet, if one is buffered
 PacketHeader
 Network::Receive(char* data)
 {
-    PacketHeader hdr = inHdr;
+    PacketHeader hdr;
 
-    inHdr.length = 0;
-    if (hdr.length != 0)
-    	bcopy(inbox, data, hdr.length);
+    if (numIn == 0) {
+	hdr.length = 0;
+	return hdr;
+    }
+    hdr = inHdr[firstIn];
+    bcopy(inbox[firstIn], data, hdr.length);
+    firstIn = (firstIn + 1) % NetworkBufferPackets;
+    numIn--;
     return hdr;
 }
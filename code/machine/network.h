@@ -40,6 +40,17 @@ class PacketHeader {
 #define MaxWireSize 	64	// largest packet that can go out on the wire
 #define MaxPacketSize 	(MaxWireSize - sizeof(struct PacketHeader))	
 				// data "payload" of the largest packet
+#define NetworkBufferPackets 16	// arrived packets the network device
+				// holds until they are received
+
+// With shared memory (-shm), each machine has a file, RING_<id>, holding 
+// a ring of packets from each of the other machines.  Only that machine 
+// puts packets in a ring and only the owner takes them out, so neither 
+// needs a lock or a host call.  The UNIX socket is then only used as a 
+// doorbell, rung when a packet goes into an empty ring, so that an idle 
+// machine can wait for one.
+#define MaxRingMachines	64	// machine ID's that can use the rings
+#define RingPackets	64	// packets each ring holds
 
 
 // The following class defines a physical network device.  The network
@@ -72,13 +83,14 @@ class Network {
     PacketHeader Receive(char* data);
     				// Poll the network for incoming messages.  
 				// If there is a packet waiting, copy the 
-				// packet into "data" and return the header.
-				// If no packet is waiting, return a header 
-				// with length 0.
+				// oldest packet into "data" and return the 
+				// header.  If no packet is waiting, return 
+				// a header with length 0.
 
     void SendDone();		// Interrupt handler, called when message is 
 				// sent
-    void CheckPktAvail();	// Check if there is an incoming packet
+    void CheckPktAvail();	// Check for incoming packets, and take
+				// in as many as there are room for
 
   private:
     NetworkAddress ident;	// This machine's network address
@@ -94,8 +106,27 @@ class Network {
     bool sendBusy;		// Packet is being sent.
     bool packetAvail;		// Packet has arrived, can be pulled off of
 				//   network
-    PacketHeader inHdr;		// Information about arrived packet
-    char inbox[MaxPacketSize];  // Data for arrived packet
+    PacketHeader inHdr[NetworkBufferPackets];
+				// Information about arrived packets
+    char inbox[NetworkBufferPackets][MaxPacketSize];
+				// Data for arrived packets
+    int firstIn;		// The oldest arrived packet
+    int numIn;			// How many have arrived and not been
+				//   received
+
+    bool sharedMemory;		// Packets go through the rings, not the 
+				//   socket
+    char *inRings;		// Our RING_<id> file, mapped
+    char *outRings[MaxRingMachines]; // The others' files, mapped when we
+				//   first send to them
+    int nextRing;		// Where the next read looks first, so that 
+				//   every machine gets a turn
+
+    bool ReadPacket(char *buffer);	// Take one packet off the wire
+    bool PutInRing(NetworkAddress to, char *buffer);
+				// Put one on the wire to "to"
+    void RingDoorbell(NetworkAddress to);
+				// Tell "to" there is a packet for it
 };
 
 #endif // NETWORK_H
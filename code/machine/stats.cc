@@ -23,6 +23,14 @@ Statistics::Statistics()
     numDiskReads = numDiskWrites = 0;
     numConsoleCharsRead = numConsoleCharsWritten = 0;
     numPageFaults = numPacketsSent = numPacketsRecvd = 0;
+    numPagesPrefetched = numPageouts = numSwapWrites = 0;
+    numMappedWrites = numRetransmits = 0;
+    numStackAllocs = numStackPoolHits = 0;
+    for (int i = 0; i < MaxProcessStats; i++) {
+	processFaults[i] = processResident[i] = 0;
+	processWorkingSet[i] = processFrameLimit[i] = 0;
+	processStart[i] = 0;
+    }
 }
 
 //----------------------------------------------------------------------
@@ -40,7 +48,22 @@ Statistics::Print()
     printf("Disk I/O: reads %d, writes %d\n", numDiskReads, numDiskWrites);
     printf("Console I/O: reads %d, writes %d\n", numConsoleCharsRead, 
 	numConsoleCharsWritten);
-    printf("Paging: faults %d\n", numPageFaults);
-    printf("Network I/O: packets received %d, sent %d\n", numPacketsRecvd, 
-	numPacketsSent);
+    printf("Paging: faults %d, prefetched %d\n", numPageFaults, 
+	numPagesPrefetched);
+    printf("Swap: pages written %d, in %d writes\n", numPageouts, 
+	numSwapWrites);
+    printf("Mapped files: pages written back %d\n", numMappedWrites);
+    for (int i = 0; i < MaxProcessStats; i++) {
+	if (processFaults[i] == 0)
+	    continue;
+	int64_t elapsed = totalTicks - processStart[i];
+	printf("  process %d: faults %d (%.2f per 1000 ticks), resident %d, "
+		"working set %d, frames allowed %d\n", i, processFaults[i],
+		elapsed > 0 ? processFaults[i] * 1000.0 / elapsed : 0.0,
+		processResident[i], processWorkingSet[i], processFrameLimit[i]);
+    }
+    printf("Network I/O: packets received %d, sent %d, resent %d\n", 
+	numPacketsRecvd, numPacketsSent, numRetransmits);
+    printf("Thread stacks: allocated %d, reused from pool %d\n", 
+	numStackAllocs, numStackPoolHits);
 }
@@ -13,6 +13,9 @@
 
 #include "copyright.h"
 
+#define MaxProcessStats	64	// processes (by address space id) we
+					// keep paging statistics for
+
 // The following class defines the statistics that are to be kept
 // about Nachos behavior -- how much time (ticks) elapsed, how
 // many user instructions executed, etc.
@@ -33,8 +36,22 @@ class Statistics {
     int numConsoleCharsRead;	// number of characters read from the keyboard
     int numConsoleCharsWritten; // number of characters written to the display
     int numPageFaults;		// number of virtual memory page faults
+    int numPagesPrefetched;	// pages read in ahead of a page fault
+    int numPageouts;		// pages written to the swap file
+    int numSwapWrites;		// writes to the swap file (pageouts
+				// are batched, so this may be fewer)
+    int numMappedWrites;	// dirty mapped pages written to their file
     int numPacketsSent;		// number of packets sent over the network
     int numPacketsRecvd;	// number of packets received over the network
+    int numRetransmits;		// packets resent because they weren't
+				// acknowledged in time
+    int processFaults[MaxProcessStats];	// page faults of each process
+    int64_t processStart[MaxProcessStats]; // time of its first page fault
+    int processResident[MaxProcessStats];  // its most recent resident set,
+    int processWorkingSet[MaxProcessStats];// working set estimate, and
+    int processFrameLimit[MaxProcessStats];// frame allocation
+    int numStackAllocs;		// thread stacks allocated from the host
+    int numStackPoolHits;	// thread stacks reused from the stack pool
 
     Statistics(); 		// initialize everything to zero
 
@@ -37,6 +37,8 @@
 #include <sys/un.h>
 #include <sys/socket.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <poll.h>
 
 #include "interrupt.h"
 #include "system.h"
@@ -80,6 +82,35 @@ PollFile(int fd)
     return TRUE;
 }
 
+//----------------------------------------------------------------------
+// WaitForFiles
+// 	Block the host process until at least one of the open files or
+//	sockets in "fds" has characters that can be read.  Used when
+//	Nachos is idle and only waiting for input, so that an idle
+//	Nachos takes no host CPU time.
+//
+//	"fds" -- the file descriptors to wait on
+//	"numFiles" -- how many there are, at most MaxIdleFiles
+//----------------------------------------------------------------------
+
+void
+WaitForFiles(int *fds, int numFiles)
+{
+    struct pollfd pfds[MaxIdleFiles];
+    int i, retVal;
+
+    ASSERT(numFiles > 0 && numFiles <= MaxIdleFiles);
+    for (i = 0; i < numFiles; i++) {
+	pfds[i].fd = fds[i];
+	pfds[i].events = POLLIN;
+	pfds[i].revents = 0;
+    }
+    do {
+	retVal = poll(pfds, numFiles, -1);	// no timeout
+    } while (retVal == -1 && errno == EINTR);
+    ASSERT(retVal > 0);
+}
+
 //----------------------------------------------------------------------
 // OpenForWrite
 // 	Open a file for writing.  Create it if it doesn't exist; truncate it 
@@ -302,6 +333,33 @@ ReadFromSocket(int sockID, char *buffer, int packetSize)
     ASSERT(retVal == packetSize);
 }
 
+//----------------------------------------------------------------------
+// TryReadFromSocket
+// 	Read a fixed size packet off the IPC port, if one is there.
+//	Returns FALSE, without waiting, if there isn't.  This is a single 
+//	host call, rather than a PollSocket and a ReadFromSocket.
+//----------------------------------------------------------------------
+bool
+TryReadFromSocket(int sockID, char *buffer, int packetSize)
+{
+    int retVal;
+    struct sockaddr_un uName;
+    socklen_t size = sizeof(uName);
+   
+    retVal = recvfrom(sockID, buffer, packetSize, MSG_DONTWAIT,
+				   (struct sockaddr *) &uName, &size);
+
+    if (retVal == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+	return FALSE;
+    if (retVal != packetSize) {
+        perror("in recvfrom");
+        printf("called: %x, got back %d, %d\n", (unsigned int) buffer, 
+	       retVal, errno);
+    }
+    ASSERT(retVal == packetSize);
+    return TRUE;
+}
+
 //----------------------------------------------------------------------
 // SendToSocket
 // 	Transmit a fixed size packet to another Nachos' IPC port.
@@ -330,6 +388,94 @@ bool SendToSocket(int sockID, char *buffer, int packetSize, char *toName) {
 }
 
 
+//----------------------------------------------------------------------
+// ClearSocket
+// 	Throw away every message waiting on the IPC port, whatever its
+//	size, without waiting for more.
+//----------------------------------------------------------------------
+void
+ClearSocket(int sockID)
+{
+    char buffer[64];
+
+    while (recv(sockID, buffer, sizeof(buffer), MSG_DONTWAIT) != -1)
+	;
+}
+
+//----------------------------------------------------------------------
+// OpenSharedFile
+// 	Map "size" bytes of the file "name" into our address space, 
+//	shared with every other process that maps it.  Return the 
+//	address it is mapped at, or NULL if it can't be.
+//
+//	"create" -- if TRUE, create the file if it doesn't exist, and 
+//		clear it to zeroes; otherwise it must already exist, 
+//		and be at least "size" bytes long
+//----------------------------------------------------------------------
+
+char *
+OpenSharedFile(char *name, int size, bool create)
+{
+    struct stat info;
+    char *addr;
+    int fd;
+
+    fd = open(name, create ? (O_RDWR | O_CREAT) : O_RDWR, 0666);
+    if (fd < 0)
+	return NULL;
+    if (create) {
+	// truncate rather than unlink, so that anyone who still has the
+	// file mapped sees the cleared one
+	if (ftruncate(fd, 0) < 0 || ftruncate(fd, size) < 0) {
+	    close(fd);
+	    return NULL;
+	}
+    } else if (fstat(fd, &info) < 0 || info.st_size < size) {
+	close(fd);
+	return NULL;
+    }
+    addr = (char *) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+				fd, 0);
+    close(fd);				// the mapping keeps the file
+    if (addr == (char *) MAP_FAILED)
+	return NULL;
+    return addr;
+}
+
+//----------------------------------------------------------------------
+// CloseSharedFile
+// 	Unmap a file mapped by OpenSharedFile.
+//----------------------------------------------------------------------
+
+void
+CloseSharedFile(char *addr, int size)
+{
+    munmap(addr, size);
+}
+
+//----------------------------------------------------------------------
+// MemoryBarrier
+// 	Make every load and store to shared memory before the call
+//	happen, as far as the other processes can see, before any after
+//	it.  __sync_synchronize needs gcc 4.1, so with an older compiler
+//	we use the host's barrier instruction ourselves.
+//----------------------------------------------------------------------
+
+void
+MemoryBarrier()
+{
+#if __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 1)
+    __sync_synchronize();
+#elif defined(HOST_SPARC)
+    asm volatile("membar #StoreLoad" ::: "memory");	// TSO: only stores
+							// can pass loads
+#elif defined(HOST_i386)
+    asm volatile("lock; addl $0,0(%%esp)" ::: "memory");
+#else
+    asm volatile("" ::: "memory");	// at least stop gcc reordering
+#endif
+}
+
 //----------------------------------------------------------------------
 // CallOnUserAbort
 // 	Arrange that "func" will be called when the user aborts (e.g., by
@@ -355,6 +501,24 @@ Delay(int seconds)
     (void) sleep((unsigned) seconds);
 }
 
+//----------------------------------------------------------------------
+// Incarnation
+// 	Return a number, never 0, that is different each time Nachos is
+//	started, so that the other machines can tell this run from an
+//	earlier one with the same network address.
+//----------------------------------------------------------------------
+
+int
+Incarnation()
+{
+    struct timeval tv;
+    int id;
+
+    gettimeofday(&tv, NULL);
+    id = (int) ((tv.tv_sec << 16) ^ tv.tv_usec ^ getpid());
+    return (id == 0) ? 1 : id;
+}
+
 //----------------------------------------------------------------------
 // Abort
 // 	Quit and drop core.
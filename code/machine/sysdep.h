@@ -17,6 +17,10 @@
 // If no characters in the file, return without waiting.
 extern bool PollFile(int fd);
 
+// Block until one of the "numFiles" files in "fds" has characters
+// to be read.
+extern void WaitForFiles(int *fds, int numFiles);
+
 // File operations: open/read/write/lseek/close, and check for error
 // For simulating the disk and the console devices.
 extern int OpenForWrite(char *name);
@@ -36,12 +40,20 @@ extern void AssignNameToSocket(char *socketName, int sockID);
 extern void DeAssignNameToSocket(char *socketName);
 extern bool PollSocket(int sockID);
 extern void ReadFromSocket(int sockID, char *buffer, int packetSize);
+extern bool TryReadFromSocket(int sockID, char *buffer, int packetSize);
 extern bool SendToSocket(int sockID, char *buffer, int packetSize,char *toName);
+extern void ClearSocket(int sockID);
+
+// Shared memory, for the network's shared memory rings
+extern char *OpenSharedFile(char *name, int size, bool create);
+extern void CloseSharedFile(char *addr, int size);
+extern void MemoryBarrier();	// order shared memory accesses
 
 // Process control: abort, exit, and sleep
 extern void Abort();
 extern void Exit(int exitCode);
 extern void Delay(int seconds);
+extern int Incarnation();	// differs each time Nachos is started
 
 // Initialize system so that cleanUp routine is called when user hits ctl-C
 extern void CallOnUserAbort(VoidNoArgFunctionPtr cleanUp);
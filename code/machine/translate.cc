@@ -232,7 +232,8 @@ Machine::Translate(int virtAddr, int* physAddr, int size, bool writing)
 	entry = &pageTable[vpn];
     } else {
         for (entry = NULL, i = 0; i < TLBSize; i++)
-    	    if (tlb[i].valid && ((unsigned) tlb[i].virtualPage == vpn)) {
+    	    if (tlb[i].valid && ((unsigned) tlb[i].virtualPage == vpn)
+				&& tlb[i].asid == currentAsid) {
 		entry = &tlb[i];			// FOUND!
 		break;
 	    }
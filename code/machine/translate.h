@@ -40,6 +40,9 @@ class TranslationEntry {
 			// page is referenced or modified.
     bool dirty;         // This bit is set by the hardware every time the
 			// page is modified.
+    int asid;		// Address space the entry belongs to.  Only 
+			// used in the TLB, where an entry only matches
+			// if this equals machine->currentAsid.
 };
 
 #endif
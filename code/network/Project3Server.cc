@@ -4,6 +4,7 @@
 #include "network.h"
 #include "post.h"
 #include "interrupt.h"
+#include "message.h"
 #include <sstream>
 #include <string>
 //#include <stdio.h>
@@ -11,32 +12,35 @@
 #include "ServerLock.cc"
 #include "ServerCond.cc"
 
-enum RequestType { UNKNOWN, CREATE_LOCK, ACQUIRE, RELEASE, DESTROY_LOCK, CREATE_CONDITION, WAIT, SIGNAL, BROADCAST, REGISTER, CREATE_MV, GET, SET };
-
 struct ServerMV {
   int value;
   string name;
+  int nextInBucket; //next MV in its hash bucket, or -1
 };
 
 struct ServerToken {
   string name;
+  int nextInBucket; //next token in its hash bucket, or -1
 };
 
-int MAX_SERVER_MVs = 1000; //the max number of server MVs
-int MAX_SERVER_TOKENS = 1000;
-
-RequestType getRequestType(char* req);
+#define InitialServerObjects 64 //entries in a table before it first grows
 
-ServerLock *serverLockTable[1000];
-ServerCond *serverCondTable[1000];
-ServerMV serverMVTable[1000];
-ServerToken serverTokenTable[1000];
+void TestRequest(Message *request, Message *reply);
 
+//The tables double when they fill up. The named ones are also indexed
+//by a hash of the name, with as many buckets as the table has entries,
+//so creating or looking up a name costs the same however many there are.
+ServerLock **serverLockTable = NULL;
+ServerCond **serverCondTable = NULL;
+ServerMV *serverMVTable = NULL;
+ServerToken *serverTokenTable = NULL;
+int *serverMVBuckets = NULL;
+int *serverTokenBuckets = NULL;
 
-int numServerLocks;
-int numServerConds;
-int numServerMVs;
-int numServerTokens;
+int numServerLocks, serverLockTableSize = 0;
+int numServerConds, serverCondTableSize = 0;
+int numServerMVs, serverMVTableSize = 0;
+int numServerTokens, serverTokenTableSize = 0;
 int numMembers;
 int maxNumMembers;
 
@@ -44,7 +48,83 @@ struct Member {
   int machineNum;
   int mailboxNum;
 };
-Member members[1000];
+Member *members;
+
+int myServer; //which of the numServers servers this is
+
+int LocalIndex(int id) {
+  // The index in my tables of the object with this ID, or -1 if it
+  // is a bad ID or another server's object
+  if(id < 0 || ServerForId(id) != myServer) {
+    return -1;
+  }
+  return ServerIndex(id);
+}
+
+void ForwardLockRequest(int op, int lockID, LockOwner client) {
+  // Have the server that owns lockID acquire or release it for client,
+  // which it answers itself
+  Message forward(op, lockID);
+
+  forward.seq = client.seq;
+  forward.numMembers = 1;
+  forward.memberMachine[0] = client.machineID;
+  forward.memberMailbox[0] = client.mailboxNum;
+  SendMessage(&forward, ServerForId(lockID), 0, 0);
+}
+
+template <class T>
+void GrowTable(T *&table, int count, int &size) {
+  // Double the size of a table holding count entries
+  int newSize = (size == 0) ? InitialServerObjects : size * 2;
+  T *newTable = new T[newSize];
+
+  for(int i = 0; i < count; i++) {
+    newTable[i] = table[i];
+  }
+  delete[] table;
+  table = newTable;
+  size = newSize;
+}
+
+template <class T>
+int FindOrAddName(T *&table, int &count, int &size, int *&buckets, char *name, bool &existed) {
+  // Return the ID of the entry in a named table called name. If there
+  // isn't one, add it at the end (growing the table and rehashing the
+  // names if it is full) and set existed to false.
+  int i;
+
+  if(size > 0) {
+    for(i = buckets[HashName(name) % size]; i != -1; i = table[i].nextInBucket) {
+      if(table[i].name == name) {
+	existed = true;
+	return i;
+      }
+    }
+  }
+  existed = false;
+
+  if(count == size) {
+    GrowTable(table, count, size);
+    delete[] buckets;
+    buckets = new int[size];
+    for(i = 0; i < size; i++) {
+      buckets[i] = -1;
+    }
+    for(i = 0; i < count; i++) {
+      int bucket = HashName(table[i].name.c_str()) % size;
+      table[i].nextInBucket = buckets[bucket];
+      buckets[bucket] = i;
+    }
+  }
+
+  i = count++;
+  int bucket = HashName(name) % size;
+  table[i].name = name;
+  table[i].nextInBucket = buckets[bucket];
+  buckets[bucket] = i;
+  return i;
+}
 
 int TestCreateLock();
 void TestAcquireLock(int theLockID);
@@ -62,23 +142,14 @@ void TestSet(int theMVID, int theValue);
 void StartProject3Server(int numberOfMembers) {
 
   maxNumMembers = numberOfMembers;
-  
-
-  stringstream ss;
+  members = new Member[maxNumMembers];
+  numMembers = 0;
 
-  PacketHeader outPktHdr, inPktHdr;
-  MailHeader outMailHdr, inMailHdr;
-  char buffer[MaxMailSize];
-
-  char* param = new char;
-  char* param2 = new char; //second param, if needed
-  char* request = new char;
-  char* response = new char;
-
-  
+  PacketHeader inPktHdr;
+  MailHeader inMailHdr;
+  Message msg;
 
   Lock *ServerLockTableLock = new Lock("Server Lock Table Lock");
-  //ServerLock serverLockTable[];
   numServerLocks = 0;
   Lock *ServerCondTableLock = new Lock("Server Cond Table Lock");
   numServerConds = 0;
@@ -91,738 +162,371 @@ void StartProject3Server(int numberOfMembers) {
 
   Lock *MemberTableLock = new Lock("Member Table Lock");
 
-  printf("Starting Server. Waiting for %d members.\n", maxNumMembers);
+  myServer = postOffice->getNetAddr();
+  if(myServer >= numServers) {
+    printf("Server machine %d is not one of the %d servers (-ns).\n", myServer, numServers);
+    interrupt->Halt();
+  }
 
-  while(true) {
-    //printf("Starting Server\n");
+  printf("Starting Server %d of %d. Waiting for %d members.\n", myServer, numServers, maxNumMembers);
 
-    postOffice->Receive(0, &inPktHdr, &inMailHdr, buffer);
-    printf("Server got \"%s\" from %d, box %d\n",buffer,inPktHdr.from,inMailHdr.from);
-    fflush(stdout);
+  while(true) {
 
-    ss.clear();
-    ss.str(buffer);
+    ReceiveMessage(0, &msg, &inPktHdr, &inMailHdr);
 
-    outPktHdr.to = inPktHdr.from;
-    outMailHdr.to = inMailHdr.from;
+    int fromMachine = inPktHdr.from;
+    int fromMailbox = inMailHdr.from;
+    bool forwarded = false;
 
-    outMailHdr.from = 0;
+    if(msg.op == MSG_ACQUIRE_FOR || msg.op == MSG_RELEASE_FOR) {
+      //another server acting for one of its clients, on a lock I own:
+      //treat it as the client's own request
+      if(msg.numMembers < 1) {
+	continue;
+      }
+      fromMachine = msg.memberMachine[0];
+      fromMailbox = msg.memberMailbox[0];
+      msg.op = (msg.op == MSG_ACQUIRE_FOR) ? MSG_ACQUIRE : MSG_RELEASE;
+      forwarded = true;
+    }
 
     LockOwner newOwner;
-    newOwner.machineID = inPktHdr.from;
-    newOwner.mailboxNum = inMailHdr.from;
+    newOwner.machineID = fromMachine;
+    newOwner.mailboxNum = fromMailbox;
+    newOwner.seq = msg.seq;
 
     CondOwner newCondOwner;
-    newCondOwner.machineID = inPktHdr.from;
-    newCondOwner.mailboxNum = inMailHdr.from;
-    
-    ss >> request;
-    ss >> param;
-
-    printf("req: %s\n", request);
-    printf("param: %s\n", param);
+    newCondOwner.machineID = fromMachine;
+    newCondOwner.mailboxNum = fromMailbox;
+    newCondOwner.seq = msg.seq;
 
     bool sendResponse = false;
     bool error = false;
-    bool mvExists = false;
-    bool tokenExists = false;
-
-    string mvName = "";
-    string tokenName = "";
+    int response = 0;
+    int response2 = 0;
+
+    //IDs from clients are converted to indexes in my tables (and bad
+    //or someone else's IDs to -1); the IDs sent back are converted back
+    int lockID = LocalIndex(msg.arg1);
+    int condID = LocalIndex(msg.arg1);
+    int mvID = LocalIndex(msg.arg1);
+    int i;
+
+    switch(msg.op) {
+
+    case MSG_CREATE_LOCK: {
+      DEBUG('n',"Server received Create Token request. Token name = %s.\n", msg.name);
+      //create the token, or find the one with this name, and return its ID.
+      //The clients' network threads pass the token around to lock it, so
+      //no ServerLock is made for it: numServerLocks stays 0, and the lock
+      //requests below all end at their bad ID checks
+      bool tokenExists;
 
-    RequestType r = getRequestType(request);
-
-    KernelLock curLock;
-    int lockID = -1;
-    int condID = -1;
-    int mvID = -2;
-    int mvValue = -1;
-
-    switch(r) {
-
-    case CREATE_LOCK:
-      printf("Server received Create Token request. Token name = %s.\n", param);
-      tokenName = param;
-      ss.clear();
-      //create the lock and return the lock ID
-      
       ServerTokenTableLock->Acquire();
-
-      if(numServerTokens >= MAX_SERVER_TOKENS) {
-	//server lock table full
-	ServerTokenTableLock->Release();
-	DEBUG('q',"Server Lock Table Full\n");
-	error = true;
-	break;
-      }
-
-      for(int i = 0; i < numServerTokens; i++) {
-	if(serverTokenTable[i].name == tokenName) {
-	  //token already exists w/ same name
-	  //printf("A token with the name \"%s\" already exists with id=%d\n",tokenName,i);
-	  lockID = i;
-	  tokenExists = true;
-	  break;
-	}
-      }
-
-      if(!tokenExists) {
-
-	serverTokenTable[numServerTokens].name = tokenName;
-
-	lockID = numServerTokens;
-	numServerTokens++;
-
-	sprintf(response, "%d", lockID); //send the client the lock ID
-      } else {
-	//the token already exists
-	sprintf(response, "%d dup", lockID); //send the client the lock ID and tell it that the token already exists
-      }
-
+      response = FindOrAddName(serverTokenTable, numServerTokens, serverTokenTableSize,
+			       serverTokenBuckets, msg.name, tokenExists);
       ServerTokenTableLock->Release();
-      
-      //sprintf(response, "%d", lockID); //send the client the lock ID
-      sendResponse = true;
+      response = ServerId(response, myServer);
 
-      /*  PROJECT 3 CREATE LOCK HERE
-      printf("Server received Create Lock request. Lock name = %s.\n", param);
-      ss.clear();
-      //create the lock and return the lock ID
-      
-      ServerLockTableLock->Acquire();
-
-      if(numServerLocks >= MAX_SERVER_LOCKS) {
-	//server lock table full
-	ServerLockTableLock->Release();
-	DEBUG('q',"Server Lock Table Full\n");
-	error = true;
-	break;
-      }
-
-      ServerLock *newLock = new ServerLock(numServerLocks);
-      serverLockTable[numServerLocks] = newLock;
-
-      lockID = numServerLocks;
-      numServerLocks++;
-      ServerLockTableLock->Release();
-      
-      sprintf(response, "%d", lockID); //send the client the lock ID
-      sendResponse = true;
-
-      */
-
-      /*
-      KernelLockTableLock->Acquire();
-
-      if(nextLockIndex >= MAX_LOCKS) {
-	KernelLockTableLock->Release();
-	DEBUG('q', "LOCK TABLE FULL\n");
-	//return -1
-      }
-      
-      osLocks[nextLockIndex].lock = new Lock(param);
-      //osLocks]nextLockIndex].as = currentThread->space;
-      osLocks[nextLockIndex].usageCounter = 0;
-      osLocks[nextLockIndex].toBeDestroyed = FALSE;
-      nextLockIndex++;
-      KernelLockTableLock->Release();
-      lockID = nextLockIndex-1;
-
-      //itoa(lockID, response, 10);
-      sprintf(response, "%d", lockID);
-
-      //response = "ok";  //TODO - put the lock ID here
-      //outMailHdr.length = sizeof(response) + 1;
+      response2 = tokenExists ? 1 : 0; //tell the client if the token already existed
       sendResponse = true;
-      */
       break;
+    }
 
-    case ACQUIRE:
-      printf("Server received Acquire request. Lock ID = %s.\n",param);
-      ss.clear();
-      ss.str(param);
-      ss>>lockID;
-      //printf("lock id: %d\n",lockID);
+    case MSG_ACQUIRE: {
+      DEBUG('n',"Server received Acquire request. Lock ID = %d.\n", lockID);
 
       ServerLockTableLock->Acquire();
       if(lockID < 0 || lockID >= numServerLocks) {
 	//this is a bad value
+	ServerLockTableLock->Release();
 	DEBUG('q',"BAD VALUE\n");
 	error = true;
 	break;
       }
       ServerLockTableLock->Release();
-      
 
+      //the lock answers once the client has it
       serverLockTable[lockID]->Acquire(newOwner);
-
-      
-
-
-      /*
-      
-      KernelLockTableLock->Acquire();
-      DEBUG('a',"ACQUIRING LOCK\n");
-
-      if(lockID < 0 || lockID >= nextLockIndex) {
-	//this is a bad value
-	DEBUG('q', "BAD VALUE\n");
-	//return
-	error = true;
-	break;
-      }
-
-      curLock = osLocks[lockID];
-      if(curLock.lock == NULL) {
-	//the lock has been destroyed
-	DEBUG('q',"LOCK HAS BEEN DESTROYED\n");
-	//return;
-	error = true;
-	break;
-      }
-
-      curLock.usageCounter++;
-      DEBUG('q',"ACQUIRING LOCK\n");
-      KernelLockTableLock->Release();
-      curLock.lock->Acquire();
-
-      response = "ok";
-      sendResponse = true;
-      */
       break;
+    }
 
-    case RELEASE:
-      printf("Server received Release request. Lock ID = %s.\n",param);
-      ss.clear();
-      ss.str(param);
-      ss>>lockID;
-      //printf("lock id: %d\n",lockID);
+    case MSG_RELEASE: {
+      DEBUG('n',"Server received Release request. Lock ID = %d.\n", lockID);
 
       ServerLockTableLock->Acquire();
       if(lockID < 0 || lockID >= numServerLocks) {
 	//this is a bad value
+	ServerLockTableLock->Release();
 	DEBUG('q',"BAD VALUE\n");
-	//error = true;
 	break;
       }
       ServerLockTableLock->Release();
 
       serverLockTable[lockID]->Release(newOwner);
 
-      sprintf(response, "%d", lockID); //send the client the released lock ID (just to confirm that there was no error)
-      
-      sendResponse = true;
-
-      /*
-      KernelLockTableLock->Acquire();
-      if(lockID < 0 || lockID >= nextLockIndex) {
-	//this is a bad value
-	DEBUG('q',"BAD VALUE\n");
-	//return;
-	error = true;
-	break;
-      }
-
-      curLock = osLocks[lockID];
-      if(curLock.lock == NULL) {
-	// the lock has been destroyed
-	DEBUG('q',"LOCK HAS BEEN DESTROYED\n");
-	//return;
-	error = true;
-	break;
-      }
-
-      DEBUG('q',"RELEASING LOCK\n");
-      
-      KernelLockTableLock->Release();
-      curLock.lock->Release();
-      curLock.usageCounter--;
-
-      response = "ok";
-      sendResponse = true;
-      */
-
+      response = msg.arg1; //send the client the released lock ID (just to confirm that there was no error)
+      sendResponse = !forwarded; //a forwarded release is part of a Wait, which is answered later
       break;
+    }
 
-    case DESTROY_LOCK:
-      printf("Server received Destroy Lock request. Lock ID = %s.\n",param);
-      ss.clear();
-      ss.str(param);
-      ss>>lockID;
-      //printf("lock id: %d\n",lockID);
+    case MSG_DESTROY_LOCK: {
+      DEBUG('n',"Server received Destroy Lock request. Lock ID = %d.\n", lockID);
 
       ServerLockTableLock->Acquire();
       if(lockID < 0 || lockID >= numServerLocks) {
 	//this is a bad value
+	ServerLockTableLock->Release();
 	DEBUG('q',"BAD VALUE\n");
-	//return;
-	//error = true;
+	error = true;
 	break;
       }
-
       ServerLockTableLock->Release();
       
       serverLockTable[lockID]->Destroy();
 
-      /*
-      curLock = osLocks[lockID];
-
-      //if lock is in use, mark it for destruction
-      if(curLock.usageCounter > 0) {
-	DEBUG('q',"CANNOT DESTROY LOCK IN USE\n");
-	curLock.toBeDestroyed = TRUE;
-	KernelLockTableLock->Release();
-	//return;
-	response = "ok"; //change to something else?
-	sendResponse = true;
-	break;
-      }
-
-      //if the lock is already destined to be destroyed, return
-      if(curLock.usageCounter == 0 || curLock.toBeDestroyed == TRUE) {
-	//destroy lock
-	curLock.toBeDestroyed = TRUE;
-	//effectively destroy lock
-	curLock.lock = NULL;
-	DEBUG('q',"DESTROYING LOCK\n");
-	KernelLockTableLock->Release();
-	response = "ok";
-	sendResponse = true;
-	break;
-      }
-      
-      //should never get to this point
-      error = true;
-      */
-
+      response = msg.arg1;
+      sendResponse = true;
       break;
+    }
 
-    case CREATE_CONDITION:
-      printf("Server received Create Condition request. Condition Name = %s.\n",param);
+    case MSG_CREATE_COND: {
+      DEBUG('n',"Server received Create Condition request.\n");
 
       ServerCondTableLock->Acquire();
 
-      if(numServerLocks >= MAX_SERVER_CONDS) {
-	//server cond table full
-	ServerCondTableLock->Release();
-	DEBUG('q',"Server Condition Table Full\n");
-	error = true;
-	break;
+      if(numServerConds == serverCondTableSize) {
+	GrowTable(serverCondTable, numServerConds, serverCondTableSize);
       }
-
       ServerCond *newCond = new ServerCond(numServerConds);
       serverCondTable[numServerConds] = newCond;
 
-      condID = numServerConds;
+      response = ServerId(numServerConds, myServer); //send the client the cond ID
       numServerConds++;
       ServerCondTableLock->Release();
       
-      sprintf(response, "%d", condID); //send the client the cond ID
-      sendResponse = true;
-
-      /*
-
-      KernelCondTableLock->Acquire();
-
-      int myCondIndex = nextCondIndex;
-      
-      //make sure the table is not full
-      if(nextCondIndex >= MAX_CONDS) {
-	//the table is full
-	KernelCondTableLock->Release();
-	DEBUG('q',"COND TABLE FULL\n");
-	//return -1;
-	error = true;
-	break;
-      }
-
-      osConds[nextCondIndex].condition = new Condition("");
-      //osConds[nextCondIndex].as = currentThread->space;
-      osConds[nextCondIndex].usageCounter = 0;
-      osConds[nextCondIndex].toBeDestroyed = FALSE;
-      
-      nextCondIndex++;
-      KernelCondTableLock->Release();
-      
-      sprintf(response, "%d", myCondIndex);
       sendResponse = true;
-
-      */
       break;
+    }
 
-    case WAIT:
-      ss>>param2; //get 2nd parameter (lock ID)
-      printf("Server received Wait request. Condition ID = %s. Lock ID = %s\n",param, param2);
-
-      ss.clear();
-      ss.str(param);
-      ss>>condID;  //1st parameter is the condition ID
-
-      ss.clear();
-      ss.str(param2);
-      ss>>lockID; //2nd parameter is the lock ID
-      
-      //printf("cond id: %d\n",condID);
-      //printf("lock id: %d\n",lockID);
-
-      //validate the condition ID
-      ServerCondTableLock->Acquire();
-      if(condID < 0 || condID >= numServerConds) {
-	//bad cond ID
-	DEBUG('q',"BAD VALUE\n");
-	error = true;
-	break;
-      }
-      ServerCondTableLock->Release();
-      
-      //validate the lock ID
-      ServerLockTableLock->Acquire();
-      if(lockID < 0 || lockID >= numServerLocks) {
-	//bad lock ID
-	DEBUG('q',"BAD VALUE\n");
-	error = true;
-	break;
-      }
-      ServerLockTableLock->Release();
-
-      
-      
-
-      //make sure the client owns the given lock ID - ?
-
-      //wait
-      newCondOwner.lockID = lockID;
-
-      printf("server: before wait: machine: %d, box: %d\n",newCondOwner.machineID, newCondOwner.mailboxNum);
-      serverCondTable[condID]->Wait(newCondOwner);
-
-      //release the lock while waiting -- need to check for ownership before releasing??
-      serverLockTable[lockID]->Release(newOwner);
-
-      break;
-
-    case SIGNAL:
-      
-      ss>>param2; //get 2nd parameter (lock ID)
-      printf("Server received Signal request. Condition ID = %s. Lock ID = %s\n",param, param2);
-
-      ss.clear();
-      ss.str(param);
-      ss>>condID;  //1st parameter is the condition ID
-
-      ss.clear();
-      ss.str(param2);
-      ss>>lockID; //2nd parameter is the lock ID
-      
-      //printf("cond id: %d\n",condID);
-      //printf("lock id: %d\n",lockID);
+    case MSG_WAIT:
+    case MSG_SIGNAL:
+    case MSG_BROADCAST: {
+      lockID = LocalIndex(msg.arg2); //2nd parameter is the lock ID
+      bool lockIsMine = (ServerForId(msg.arg2) == myServer); //else another server has it
+      DEBUG('n',"Server received op %d. Condition ID = %d. Lock ID = %d\n", msg.op, msg.arg1, msg.arg2);
 
       //validate the condition ID
       ServerCondTableLock->Acquire();
       if(condID < 0 || condID >= numServerConds) {
 	//bad cond ID
+	ServerCondTableLock->Release();
 	DEBUG('q',"BAD VALUE\n");
-	//error = true;
+	error = (msg.op == MSG_WAIT);
 	break;
       }
       ServerCondTableLock->Release();
       
-      //validate the lock ID
+      //validate the lock ID, if the lock is mine (its server checks it
+      //otherwise). There are no ServerLocks (see MSG_CREATE_LOCK), so a
+      //lock of mine is always rejected here, and the lock's server drops
+      //a forwarded release and answers a forwarded acquire with an error:
+      //AcquireAll and the lock half of the forwarding never get further
       ServerLockTableLock->Acquire();
-      if(lockID < 0 || lockID >= numServerLocks) {
+      if(lockIsMine && (lockID < 0 || lockID >= numServerLocks)) {
 	//bad lock ID
+	ServerLockTableLock->Release();
 	DEBUG('q',"BAD VALUE\n");
-	//error = true;
+	error = (msg.op == MSG_WAIT);
 	break;
       }
-
       ServerLockTableLock->Release();
-      
-      //get the client to wake up
-      ClientAddr clientToWake = serverCondTable[condID]->Signal(newCondOwner);
 
-      printf("client to wake --> machineID: %d, mailboxNum: %d\n",clientToWake.machineID, clientToWake.mailboxNum);
-      
-      if(clientToWake.machineID != -1 && clientToWake.mailboxNum != -1) {
-	//send a message to the client to wake
-	//acquire the lock (the Acquire will send the message to the client)
-
-	LockOwner clientToWake_L;
-	clientToWake_L.machineID = clientToWake.machineID;
-	clientToWake_L.mailboxNum = clientToWake.mailboxNum;
-	
-	printf("client to wake (from LockOwner)--> machineID: %d, mailboxNum: %d\n",clientToWake_L.machineID, clientToWake_L.mailboxNum);
-	
-	serverLockTable[lockID]->Acquire(clientToWake_L);
-	
-      } else {
-	//no one was waiting on the CV
-	//do nothing
-      }
-
-      break;
+      if(msg.op == MSG_WAIT) {
+	//wait; the client is answered when it gets the lock back
+	newCondOwner.lockID = msg.arg2;
+	serverCondTable[condID]->Wait(newCondOwner);
 
-    case BROADCAST:
-      
-      ss>>param2; //get 2nd parameter (lock ID)
-      printf("Server received Broadcast request. Condition ID = %s. Lock ID = %s\n",param, param2);
-
-      ss.clear();
-      ss.str(param);
-      ss>>condID;  //1st parameter is the condition ID
-
-      ss.clear();
-      ss.str(param2);
-      ss>>lockID; //2nd parameter is the lock ID
-      
-      //printf("cond id: %d\n",condID);
-      //printf("lock id: %d\n",lockID);
-
-      //validate the condition ID
-      ServerCondTableLock->Acquire();
-      if(condID < 0 || condID >= numServerConds) {
-	//bad cond ID
-	DEBUG('q',"BAD VALUE\n");
-	//error = true;
-	break;
-      }
-      ServerCondTableLock->Release();
-      
-      //validate the lock ID
-      ServerLockTableLock->Acquire();
-      if(lockID < 0 || lockID >= numServerLocks) {
-	//bad lock ID
-	DEBUG('q',"BAD VALUE\n");
-	error = true;
+	//release the lock while waiting -- need to check for ownership before releasing??
+	if(lockIsMine) {
+	  serverLockTable[lockID]->Release(newOwner);
+	} else {
+	  ForwardLockRequest(MSG_RELEASE_FOR, msg.arg2, newOwner);
+	}
 	break;
       }
 
-      ServerLockTableLock->Release();
-
-      ClientAddr* clientsToWake = serverCondTable[condID]->Broadcast();
+      //the clients to wake up; they get the lock back (and their
+      //answer) in the order they waited
+      ServerQueue<LockOwner> woken;
 
-      for(int i=0; i < sizeof(clientsToWake); i++) {
-      
+      if(msg.op == MSG_SIGNAL) {
 	//get the client to wake up
-	ClientAddr clientToWake = clientsToWake[i];
+	ClientAddr clientToWake = serverCondTable[condID]->Signal(newCondOwner);
 
-	printf("client to wake --> machineID: %d, mailboxNum: %d\n",clientToWake.machineID, clientToWake.mailboxNum);
-      
+	DEBUG('n',"client to wake --> machineID: %d, mailboxNum: %d\n",clientToWake.machineID, clientToWake.mailboxNum);
 	if(clientToWake.machineID != -1 && clientToWake.mailboxNum != -1) {
-	  //send a message to the client to wake
-	  //acquire the lock (the Acquire will send the message to the client)
-
 	  LockOwner clientToWake_L;
 	  clientToWake_L.machineID = clientToWake.machineID;
 	  clientToWake_L.mailboxNum = clientToWake.mailboxNum;
-	
-	  printf("client to wake (from LockOwner)--> machineID: %d, mailboxNum: %d\n",clientToWake_L.machineID, clientToWake_L.mailboxNum);
-	
-	  serverLockTable[lockID]->Acquire(clientToWake_L);
-	
+	  clientToWake_L.seq = clientToWake.seq;
+	  woken.Append(clientToWake_L);
 	} else {
 	  //no one was waiting on the CV
 	  //do nothing
 	}
+      } else {
+	serverCondTable[condID]->Broadcast(woken);
+      }
 
-      } //for
-      
+      if(lockIsMine) {
+	//acquire the lock for all of them at once (the lock sends the
+	//message to each client as it gets it)
+	serverLockTable[lockID]->AcquireAll(woken);
+      } else {
+	LockOwner clientToWake_L;
+	while(woken.Remove(clientToWake_L)) {
+	  ForwardLockRequest(MSG_ACQUIRE_FOR, msg.arg2, clientToWake_L);
+	}
+      }
       break;
+    }
 
-    case REGISTER:
-      printf("Server received a registration message (join) request from machine %d, box %d.\n", inPktHdr.from, inMailHdr.from);
-      
-      //TODO - add the member's info to a list or something
+    case MSG_REGISTER: {
+      DEBUG('n',"Server received a registration message (join) request from machine %d, box %d.\n", fromMachine, fromMailbox);
       
       MemberTableLock->Acquire();
 
-      members[numMembers].machineNum = inPktHdr.from;
-      members[numMembers].mailboxNum = inMailHdr.from;
+      if(numMembers == maxNumMembers) {
+	//the group is already complete
+	MemberTableLock->Release();
+	DEBUG('q',"Member Table Full\n");
+	break;
+      }
+      members[numMembers].machineNum = fromMachine;
+      members[numMembers].mailboxNum = fromMailbox;
 
       numMembers++;
       if(numMembers == maxNumMembers) {
 	printf("Reached the desired number of members (%d).\n", maxNumMembers);
-	//Send message to each member containing a list of the other members.
-	string memberListStr = "X";
-	ss.clear();
-	//ss << ".";
 	printf("Member List Generated:\n");
-	for(int i = 0; i < numMembers; i++) {
-	  memberListStr.append(" ");
-	  char tempBuf[10];
-	  sprintf(tempBuf,"%d",members[i].machineNum);
-	  memberListStr.append(tempBuf);
-	  memberListStr.append(",");
-	  sprintf(tempBuf,"%d",members[i].mailboxNum);
-	  memberListStr.append(tempBuf);
-	  //memberListStr.append(" ");
+	for(i = 0; i < numMembers; i++) {
 	  printf("   Machine: %d, Mailbox: %d\n", members[i].machineNum, members[i].mailboxNum);
-	  //ss << members[i].machineNum << "," << members[i].mailboxNum << " ";
 	}
-	//ss>>memberListStr;
-	//memberListStr.append(">");
-	//cout<<"member list: "<<memberListStr<<endl;
-
-	char* memberListToSend = new char[memberListStr.size() + 1];
-	strcpy(memberListToSend, memberListStr.c_str());
 
-	//cout<<"member list to send: "<<memberListToSend<<endl;
-	//cout<<"size of member list: "<<sizeof(memberListToSend)<<endl;
-	//cout<<"max mail size: "<<MaxMailSize<<endl;
-	
-
-	outMailHdr.length = strlen(memberListToSend) + 1;
-
-	for(int i = 0; i < numMembers; i++) {
-	  outPktHdr.to = members[i].machineNum;
-	  outMailHdr.to = members[i].mailboxNum;
+	//Send each member the list of members, as many messages as
+	//it takes to hold it
+	Message list(MSG_MEMBERS, numMembers);
+	for(int first = 0; first < numMembers; first += MaxMessageMembers) {
+	  list.arg2 = first;
+	  list.numMembers = 0;
+	  for(i = first; i < numMembers && i < first + MaxMessageMembers; i++) {
+	    list.memberMachine[list.numMembers] = members[i].machineNum;
+	    list.memberMailbox[list.numMembers] = members[i].mailboxNum;
+	    list.numMembers++;
+	  }
 
-	  bool success = postOffice->Send(outPktHdr, outMailHdr, memberListToSend);
-	  if(!success) {
-	    //sending response to client failed
-	    printf("The postOffice Send failed. Terminating Nachos.\n");
-	    interrupt->Halt();
+	  for(i = 0; i < numMembers; i++) {
+	    SendMessage(&list, members[i].machineNum, members[i].mailboxNum, 0);
 	  }
 	}
       }
       MemberTableLock->Release();
-
       break;
+    }
 
-    case CREATE_MV:
-      printf("Server received Create MV request. MV name = %s.From %d,%d\n", param, inPktHdr.from, inMailHdr.from);
-      mvName = param;
-      ss.clear();
-      //create the MV and return the lock ID
+    case MSG_CREATE_MV: {
+      DEBUG('n',"Server received Create MV request. MV name = %s. From %d,%d\n", msg.name, fromMachine, fromMailbox);
+      //create the MV, or find the one with this name, and return its ID
+      bool mvExists;
       
       ServerMVTableLock->Acquire();
-
-      printf("Num Server MVs: %d\n",numServerMVs);
-
-      if(numServerMVs >= MAX_SERVER_MVs) {
-	printf("**   NumServerMVs: %d, MAX_SERVER_MVs: %d\n",numServerMVs, MAX_SERVER_MVs);
-	//server MV table full
-	ServerMVTableLock->Release();
-	DEBUG('q',"Server MV Table Full\n");
-	error = true;
-	break;
-      }
-
-      for(int i=0; i < numServerMVs; i++) {
-	if(serverMVTable[i].name == mvName) {
-	  //a MV with the same name already exists
-	  //printf("MV name \n%s\" already exists. Sending existing MV ID=%d\n",mvName, i);
-	  mvExists = true;
-	  mvID = i;
-	  break;
-	}
-      }
-
+      mvID = FindOrAddName(serverMVTable, numServerMVs, serverMVTableSize,
+			   serverMVBuckets, msg.name, mvExists);
       if(!mvExists) {
-	serverMVTable[numServerMVs].value = 0;
-	serverMVTable[numServerMVs].name = mvName;
-
-	mvID = numServerMVs;
-	numServerMVs++;
-      } else {
-	//MV already exists
+	serverMVTable[mvID].value = 0;
       }
       ServerMVTableLock->Release();
-      
-      sprintf(response, "%d", mvID); //send the client the MV ID
+
+      response = ServerId(mvID, myServer);
+
       sendResponse = true;
       break;
+    }
 
-    case GET:
-      printf("Server received Get request. MV ID = %s.\n",param);
-      ss.clear();
-      ss.str(param);
-      ss>>mvID;
-      //printf("MV id: %d\n",lockID);
+    case MSG_GET_MV: {
+      DEBUG('n',"Server received Get request. MV ID = %d.\n", mvID);
 
       ServerMVTableLock->Acquire();
       if(mvID < 0 || mvID >= numServerMVs) {
-	//this is a bad value
+	ServerMVTableLock->Release();
 	DEBUG('q',"BAD VALUE\n");
-	//error = true;
+	error = true;
 	break;
       }
-
-      mvValue = serverMVTable[mvID].value;
-
+      response = serverMVTable[mvID].value;
       ServerMVTableLock->Release();
 
-      //send the value to the client
-      sprintf(response, "%d", mvValue);
       sendResponse = true;
-     
       break;
+    }
 
-    case SET:
-      ss>>param2; //get 2nd parameter (MV value)
-      printf("Server received Set request. MV ID = %s, Value = %s.\n",param,param2);
-      ss.clear();
-      ss.str(param);
-      ss>>mvID;
-
-      //int mvValue;
-      ss.clear();
-      ss.str(param2);
-      ss>>mvValue;
-      //printf("MV id: %d\n",lockID);
+    case MSG_SET_MV: {
+      DEBUG('n',"Server received Set request. MV ID = %d, Value = %d.\n", mvID, msg.arg2);
 
       ServerMVTableLock->Acquire();
       if(mvID < 0 || mvID >= numServerMVs) {
-	//this is a bad value
+	ServerMVTableLock->Release();
 	DEBUG('q',"BAD VALUE\n");
-	// error = true;
 	break;
       }
+      serverMVTable[mvID].value = msg.arg2;
+      ServerMVTableLock->Release();
+      break;
+    }
 
-      serverMVTable[mvID].value = mvValue;
+    case MSG_BATCH: {
+      // Several Gets and Sets at once: answer them all, in order, in
+      // one reply, with each item's value (or MessageError) in its arg1
+      DEBUG('n',"Server received a batch of %d MV requests.\n", msg.numItems);
 
-      ServerMVTableLock->Release();
+      Message *reply = new Message(MSG_REPLY, msg.numItems);
+      reply->seq = msg.seq;
+      reply->numItems = msg.numItems;
 
+      ServerMVTableLock->Acquire();
+      for(i = 0; i < msg.numItems; i++) {
+	int id = LocalIndex(msg.itemArg1[i]);
+
+	reply->itemOp[i] = msg.itemOp[i];
+	reply->itemArg2[i] = msg.itemArg2[i];
+	if(id < 0 || id >= numServerMVs ||
+	   (msg.itemOp[i] != MSG_GET_MV && msg.itemOp[i] != MSG_SET_MV)) {
+	  reply->itemArg1[i] = MessageError;
+	  continue;
+	}
+	if(msg.itemOp[i] == MSG_SET_MV) {
+	  serverMVTable[id].value = msg.itemArg2[i];
+	}
+	reply->itemArg1[i] = serverMVTable[id].value;
+      }
+      ServerMVTableLock->Release();
 
-      sendResponse = false;
-      break;
-      
-    case UNKNOWN:
-      printf("Server received an Unknown request.\n");
+      SendMessage(reply, fromMachine, fromMailbox, 0);
+      delete reply;
       break;
+    }
 
+    default:
+      printf("Server received an Unknown request (op %d).\n", msg.op);
+      break;
     }
 
     if(sendResponse) {
-      //Send a message back to the client
-      outMailHdr.length = sizeof(response) + 1;
-      bool success = postOffice->Send(outPktHdr, outMailHdr, response);
-      if(!success) {
-	//sending response to client failed
-	printf("The postOffice Send failed. Terminating Nachos.\n");
-	interrupt->Halt();
-      } else {
-	printf("Server sent response to client machine=%d, box=%d, response=%s.\n",outPktHdr.to,outMailHdr.to,response);
-      }
-    } 
-       
-    else if(error) {
-      //error doing something, send a message to client
-      
-      //todo- send error msg to client
-      sprintf(response, "%d", -3);
-      outMailHdr.length = sizeof(response) + 1;
-      bool success = postOffice->Send(outPktHdr, outMailHdr, response);
-      if(!success) {
-	//sending response to client failed
-	printf("The postOffice Send failed. Terminating Nachos.\n");
-	interrupt->Halt();
-      } else {
-	printf("Sent response to client.\n");
-      }
+      SendReply(&msg, response, response2, fromMachine, fromMailbox, 0);
+    } else if(error) {
+      SendReply(&msg, MessageError, 0, fromMachine, fromMailbox, 0);
     }
-    
-
   }
 
 }
@@ -837,214 +541,78 @@ void TestProject3() {
 
   TestGet(newMVID);
 
-  //printf("creating lock\n");
-  //int createLockID = TestCreateLock();
-  //int createLockID2 = TestCreateLock();
-
-  //printf("acquiring lock #%d\n",createLockID);
-  //TestAcquireLock(createLockID);
-  //printf("trying to acquire same lock again\n");
-  //TestAcquireLock(createLockID);
-
-  //TestReleaseLock(createLockID);
-
-  //TestDestroyLock(createLockID);
+}
 
-  //printf("creating condition\n");
-  //int createCondID = TestCreateCondition();
+void TestRequest(Message *request, Message *reply) {
+  // Send "request" to the server from mailbox 1, and wait there for an
+  // answer if "reply" is not NULL
 
-  //printf("waiting on CV #%d with Lock #%d\n", createCondID, createLockID);
-  //TestWait(createCondID, createLockID);
+  PacketHeader inPktHdr;
+  MailHeader inMailHdr;
 
-  //printf("signaling CV #%d with Lock #%d\n", createCondID, createLockID);
-  //TestSignal(createCondID, createLockID);
+  request->seq = NextMessageSeq();
+  SendMessage(request, 0, 0, 1); //hard coded to 0 for testing
 
-  //printf("broadcasting CV #%d with Lock #%d\n", createCondID, createLockID);
-  //TestBroadcast(createCondID, createLockID);
+  if(reply != NULL) {
+    ReceiveMessage(1, reply, &inPktHdr, &inMailHdr);
+    printf("Got op %d (%d, %d) from %d, box %d\n",reply->op,reply->arg1,reply->arg2,inPktHdr.from,inMailHdr.from);
+    fflush(stdout);
+  }
 
 }
 
 void TestSet(int theMVID, int theValue) {
 
-  stringstream ss;
-
-  int myClientNum = 1;
-
-  PacketHeader outPktHdr, inPktHdr;
-  MailHeader outMailHdr, inMailHdr;
-  char buffer[MaxMailSize];
-  //char *data = "L 1234";
-
-  sprintf(buffer, "SMV %d %d", theMVID, theValue);
-
-  //ss<<"A "<<theLockID;
-
-  //ss>>buffer;
-
-
-  outPktHdr.to = 0; //hard coded to 0 for testing
-  outMailHdr.to = 0;
-  outMailHdr.from = 1;
-  outMailHdr.length = strlen(buffer) + 1;
-
-  bool success = postOffice->Send(outPktHdr, outMailHdr, buffer);
-
-  if(!success) {
-    printf("The postOffice Send failed.\n");
-    interrupt->Halt();
-  }
-
-  
-
+  Message request(MSG_SET_MV, theMVID, theValue);
 
+  TestRequest(&request, NULL);
 
 }
 
 void TestGet(int theMVID) {
 
-  stringstream ss;
-
-  int myClientNum = 1;
-
-  PacketHeader outPktHdr, inPktHdr;
-  MailHeader outMailHdr, inMailHdr;
-  char buffer[MaxMailSize];
-  //char *data = "L 1234";
-
-  sprintf(buffer, "GMV %d", theMVID);
-
-  //ss<<"A "<<theLockID;
-
-  //ss>>buffer;
-
-
-  outPktHdr.to = 0; //hard coded to 0 for testing
-  outMailHdr.to = 0;
-  outMailHdr.from = 1;
-  outMailHdr.length = strlen(buffer) + 1;
-
-  bool success = postOffice->Send(outPktHdr, outMailHdr, buffer);
-
-  if(!success) {
-    printf("The postOffice Send failed.\n");
-    interrupt->Halt();
-  }
-
-  
-  postOffice->Receive(myClientNum, &inPktHdr, &inMailHdr, buffer);
-  printf("Got \"%s\" from %d, box %d\n",buffer,inPktHdr.from,inMailHdr.from);
-  fflush(stdout);
+  Message request(MSG_GET_MV, theMVID), reply;
 
-  ss.str(buffer);
-  int mvVal_rec;
-  ss>>mvVal_rec;
+  TestRequest(&request, &reply);
 
-  if(mvVal_rec < 0) {
-    printf("Error Getting the MV value. Server Response=%d.\n",mvVal_rec);
+  if(reply.arg1 < 0) {
+    printf("Error Getting the MV value. Server Response=%d.\n",reply.arg1);
   } else {
-    printf("Successfully Got the MV value. Server Response=%d.\n",mvVal_rec);
+    printf("Successfully Got the MV value. Server Response=%d.\n",reply.arg1);
   }
 
-
 }
 
 int TestCreateMV() {
 
-  stringstream ss;
-
-  int myClientNum = 1;
-
-  PacketHeader outPktHdr, inPktHdr;
-  MailHeader outMailHdr, inMailHdr;
-  char buffer[MaxMailSize];
-  char *data = "CMV name";
-
-
-
-  outPktHdr.to = 0; //hard coded to 0 for testing
-  outMailHdr.to = 0;
-  outMailHdr.from = 1;
-  outMailHdr.length = strlen(data) + 1;
+  Message request(MSG_CREATE_MV), reply;
 
-  bool success = postOffice->Send(outPktHdr, outMailHdr, data);
+  strcpy(request.name, "name");
+  TestRequest(&request, &reply);
 
-  if(!success) {
-    printf("The postOffice Send failed.\n");
-    interrupt->Halt();
-  }
-
-  
-  postOffice->Receive(myClientNum, &inPktHdr, &inMailHdr, buffer);
-  printf("Got \"%s\" from %d, box %d\n",buffer,inPktHdr.from,inMailHdr.from);
-  fflush(stdout);
-
-  ss.str(buffer);
-  int mvID_rec;
-  ss>>mvID_rec;
-
-  return mvID_rec;
+  return reply.arg1;
 
 }
 
 void TestRegister() {
 
-  stringstream ss;
-
-  int myClientNum = 1;
-
-  PacketHeader outPktHdr, inPktHdr;
-  MailHeader outMailHdr, inMailHdr;
-  char buffer[MaxMailSize];
-  char *data = "J";
-
-
-
-  outPktHdr.to = 0; //hard coded to 0 for testing
-  outMailHdr.to = 0;
-  outMailHdr.from = 1;
-  outMailHdr.length = strlen(data) + 1;
-
-  bool success = postOffice->Send(outPktHdr, outMailHdr, data);
+  Message request(MSG_REGISTER), reply;
+  PacketHeader inPktHdr;
+  MailHeader inMailHdr;
+  int numClients = 0;
 
-  if(!success) {
-    printf("The postOffice Send failed.\n");
-    interrupt->Halt();
-  }
+  TestRequest(&request, &reply);
 
-  //cout<<"buffer: "<<buffer<<endl;
-  
-  postOffice->Receive(myClientNum, &inPktHdr, &inMailHdr, buffer);
-  printf("Got \"%s\" from %d, box %d\n",buffer,inPktHdr.from,inMailHdr.from);
-  //cout<<buffer<<endl;
-  fflush(stdout);
-  
-  ss.clear();
-  ss.str(buffer);
-  /*
-  int lockID_rec;
-  ss>>lockID_rec;
-
-  return lockID_rec;
-  */
-  string currentClient;
-  int numClients = 0;
-  Member clients[1000];
   printf("Member List Received:\n");
-  while( getline(ss, currentClient, ' ')) {
-    
-    int firstCommaPos = currentClient.find_first_of(",");
-    //cout<<"firstCommaPos:"<<firstCommaPos<<endl;
-    //int lastPeriodPos = currentClient.find_last_of(".");
-    string machineNumStr = currentClient.substr(0,firstCommaPos);
-    string mailboxNumStr = currentClient.substr(firstCommaPos+1);
-    //cout<<"machine num: "<<machineNumStr<<" mailbox num: "<<mailboxNumStr<<endl;
-    int machineNum = atoi(machineNumStr.c_str());
-    int mailboxNum = atoi(mailboxNumStr.c_str());
-    clients[numClients].machineNum = machineNum;
-    clients[numClients].mailboxNum = mailboxNum;
-    numClients++;
-    printf("   Machine: %d, Mailbox: %d\n", machineNum, mailboxNum);
-    //cout<<"machine num: "<<machineNum<<" mailbox num: "<<mailboxNum<<endl;
+  while(true) {
+    for(int i = 0; i < reply.numMembers; i++) {
+      printf("   Machine: %d, Mailbox: %d\n", reply.memberMachine[i], reply.memberMailbox[i]);
+    }
+    numClients += reply.numMembers;
+    if(numClients >= reply.arg1) {
+      break;
+    }
+    ReceiveMessage(1, &reply, &inPktHdr, &inMailHdr); //the rest of the list
   }
   printf("There are %d clients (including myself)\n",numClients);
 
@@ -1052,372 +620,81 @@ void TestRegister() {
 
 int TestCreateLock() {
 
-  stringstream ss;
-
-  int myClientNum = 1;
-
-  PacketHeader outPktHdr, inPktHdr;
-  MailHeader outMailHdr, inMailHdr;
-  char buffer[MaxMailSize];
-  char *data = "L 1234";
-
+  Message request(MSG_CREATE_LOCK), reply;
 
+  strcpy(request.name, "1234");
+  TestRequest(&request, &reply);
 
-  outPktHdr.to = 0; //hard coded to 0 for testing
-  outMailHdr.to = 0;
-  outMailHdr.from = 1;
-  outMailHdr.length = strlen(data) + 1;
-
-  bool success = postOffice->Send(outPktHdr, outMailHdr, data);
-
-  if(!success) {
-    printf("The postOffice Send failed.\n");
-    interrupt->Halt();
-  }
-
-  
-  postOffice->Receive(myClientNum, &inPktHdr, &inMailHdr, buffer);
-  printf("Got \"%s\" from %d, box %d\n",buffer,inPktHdr.from,inMailHdr.from);
-  fflush(stdout);
-
-  ss.str(buffer);
-  int lockID_rec;
-  ss>>lockID_rec;
-
-  return lockID_rec;
+  return reply.arg1;
 
 }
 
 void TestAcquireLock(int theLockID) {
 
-  stringstream ss;
-
-  int myClientNum = 1;
-
-  PacketHeader outPktHdr, inPktHdr;
-  MailHeader outMailHdr, inMailHdr;
-  char buffer[MaxMailSize];
-  //char *data = "L 1234";
-
-  sprintf(buffer, "A %d", theLockID);
+  Message request(MSG_ACQUIRE, theLockID), reply;
 
-  //ss<<"A "<<theLockID;
+  TestRequest(&request, &reply);
 
-  //ss>>buffer;
-
-
-  outPktHdr.to = 0; //hard coded to 0 for testing
-  outMailHdr.to = 0;
-  outMailHdr.from = 1;
-  outMailHdr.length = strlen(buffer) + 1;
-
-  bool success = postOffice->Send(outPktHdr, outMailHdr, buffer);
-
-  if(!success) {
-    printf("The postOffice Send failed.\n");
-    interrupt->Halt();
-  }
-
-  
-  postOffice->Receive(myClientNum, &inPktHdr, &inMailHdr, buffer);
-  printf("Got \"%s\" from %d, box %d\n",buffer,inPktHdr.from,inMailHdr.from);
-  fflush(stdout);
-
-  ss.str(buffer);
-  int lockID_rec;
-  ss>>lockID_rec;
-
-  if(lockID_rec < 0) {
-    printf("Error acquiring lock. Server Response=%d.\n",lockID_rec);
+  if(reply.arg1 < 0) {
+    printf("Error acquiring lock. Server Response=%d.\n",reply.arg1);
   } else {
-    printf("Successfully acquired lock. Server Response=%d.\n",lockID_rec);
+    printf("Successfully acquired lock. Server Response=%d.\n",reply.arg1);
   }
 
-
 }
 
 void TestReleaseLock(int theLockID) {
 
-  stringstream ss;
-
-  int myClientNum = 1;
-
-  PacketHeader outPktHdr, inPktHdr;
-  MailHeader outMailHdr, inMailHdr;
-  char buffer[MaxMailSize];
-  //char *data = "L 1234";
-
-  sprintf(buffer, "R %d", theLockID);
+  Message request(MSG_RELEASE, theLockID), reply;
 
-  //ss<<"A "<<theLockID;
+  TestRequest(&request, &reply);
 
-  //ss>>buffer;
-
-
-  outPktHdr.to = 0; //hard coded to 0 for testing
-  outMailHdr.to = 0;
-  outMailHdr.from = 1;
-  outMailHdr.length = strlen(buffer) + 1;
-
-  bool success = postOffice->Send(outPktHdr, outMailHdr, buffer);
-
-  if(!success) {
-    printf("The postOffice Send failed.\n");
-    interrupt->Halt();
-  }
-
-  
-  postOffice->Receive(myClientNum, &inPktHdr, &inMailHdr, buffer);
-  printf("Got \"%s\" from %d, box %d\n",buffer,inPktHdr.from,inMailHdr.from);
-  fflush(stdout);
-
-  ss.str(buffer);
-  int lockID_rec;
-  ss>>lockID_rec;
-
-  if(lockID_rec < 0) {
-    //there was an error releasing the lock
+  if(reply.arg1 < 0) {
     printf("Received Lock Release ERROR.\n");
   } else {
-    //lock released successfully
     printf("Received Lock Released confirmation.\n");
   }
 
-
 }
 
 void TestDestroyLock(int theLockID) {
 
-  stringstream ss;
-
-  int myClientNum = 1;
-
-  PacketHeader outPktHdr, inPktHdr;
-  MailHeader outMailHdr, inMailHdr;
-  char buffer[MaxMailSize];
-  //char *data = "L 1234";
-
-  sprintf(buffer, "D %d", theLockID);
-
-  //ss<<"A "<<theLockID;
-
-  //ss>>buffer;
-
-
-  outPktHdr.to = 0; //hard coded to 0 for testing
-  outMailHdr.to = 0;
-  outMailHdr.from = 1;
-  outMailHdr.length = strlen(buffer) + 1;
-
-  bool success = postOffice->Send(outPktHdr, outMailHdr, buffer);
-
-  if(!success) {
-    printf("The postOffice Send failed.\n");
-    interrupt->Halt();
-  }
-
-  
-  postOffice->Receive(myClientNum, &inPktHdr, &inMailHdr, buffer);
-  printf("Got \"%s\" from %d, box %d\n",buffer,inPktHdr.from,inMailHdr.from);
-  fflush(stdout);
-
-  //ss.str(buffer);
-  //int lockID_rec;
-  //ss>>lockID_rec;
+  Message request(MSG_DESTROY_LOCK, theLockID), reply;
 
+  TestRequest(&request, &reply);
 
 }
 
 int TestCreateCondition() {
 
-  stringstream ss;
-
-  int myClientNum = 1;
-
-  PacketHeader outPktHdr, inPktHdr;
-  MailHeader outMailHdr, inMailHdr;
-  char buffer[MaxMailSize];
-  char *data = "C 1234";
-
+  Message request(MSG_CREATE_COND), reply;
 
+  TestRequest(&request, &reply);
 
-  outPktHdr.to = 0; //hard coded to 0 for testing
-  outMailHdr.to = 0;
-  outMailHdr.from = 1;
-  outMailHdr.length = strlen(data) + 1;
-
-  bool success = postOffice->Send(outPktHdr, outMailHdr, data);
-
-  if(!success) {
-    printf("The postOffice Send failed.\n");
-    interrupt->Halt();
-  }
-
-  
-  postOffice->Receive(myClientNum, &inPktHdr, &inMailHdr, buffer);
-  printf("Got \"%s\" from %d, box %d\n",buffer,inPktHdr.from,inMailHdr.from);
-  fflush(stdout);
-
-  ss.str(buffer);
-  int condID_rec;
-  ss>>condID_rec;
-
-  return condID_rec;
+  return reply.arg1;
 
 }
 
 void TestWait(int theCondID, int theLockID) {
 
-  stringstream ss;
-
-  int myClientNum = 1;
-
-  PacketHeader outPktHdr, inPktHdr;
-  MailHeader outMailHdr, inMailHdr;
-  char buffer[MaxMailSize];
-  //char *data = "L 1234";
-
-  sprintf(buffer, "W %d %d", theCondID, theLockID);
-
-  //ss<<"A "<<theLockID;
-
-  //ss>>buffer;
-
-
-  outPktHdr.to = 0; //hard coded to 0 for testing
-  outMailHdr.to = 0;
-  outMailHdr.from = 1;
-  outMailHdr.length = strlen(buffer) + 1;
-
-  bool success = postOffice->Send(outPktHdr, outMailHdr, buffer);
-
-  if(!success) {
-    printf("The postOffice Send failed.\n");
-    interrupt->Halt();
-  }
-
-  //Wait does not expect any response message
-  //postOffice->Receive(myClientNum, &inPktHdr, &inMailHdr, buffer);
-  //printf("Got \"%s\" from %d, box %d\n",buffer,inPktHdr.from,inMailHdr.from);
-  //fflush(stdout);
-
-
+  Message request(MSG_WAIT, theCondID, theLockID);
 
+  TestRequest(&request, NULL);
 
 }
 
 void TestSignal(int theCondID, int theLockID) {
 
-  stringstream ss;
-
-  int myClientNum = 1;
-
-  PacketHeader outPktHdr, inPktHdr;
-  MailHeader outMailHdr, inMailHdr;
-  char buffer[MaxMailSize];
-  //char *data = "L 1234";
-
-  sprintf(buffer, "S %d %d", theCondID, theLockID);
-
-  //ss<<"A "<<theLockID;
-
-  //ss>>buffer;
-
-
-  outPktHdr.to = 0; //hard coded to 0 for testing
-  outMailHdr.to = 0;
-  outMailHdr.from = 1;
-  outMailHdr.length = strlen(buffer) + 1;
-
-  bool success = postOffice->Send(outPktHdr, outMailHdr, buffer);
-
-  if(!success) {
-    printf("The postOffice Send failed.\n");
-    interrupt->Halt();
-  }
-
-  
-  postOffice->Receive(myClientNum, &inPktHdr, &inMailHdr, buffer);
-  printf("Got \"%s\" from %d, box %d\n",buffer,inPktHdr.from,inMailHdr.from);
-  fflush(stdout);
-
-  //ss.str(buffer);
-  //int lockID_rec;
-  //ss>>lockID_rec;
+  Message request(MSG_SIGNAL, theCondID, theLockID);
 
+  TestRequest(&request, NULL);
 
 }
 
 void TestBroadcast(int theCondID, int theLockID) {
 
-  stringstream ss;
-
-  int myClientNum = 1;
-
-  PacketHeader outPktHdr, inPktHdr;
-  MailHeader outMailHdr, inMailHdr;
-  char buffer[MaxMailSize];
-  //char *data = "L 1234";
-
-  sprintf(buffer, "B %d %d", theCondID, theLockID);
-
-  //ss<<"A "<<theLockID;
-
-  //ss>>buffer;
-
+  Message request(MSG_BROADCAST, theCondID, theLockID);
 
-  outPktHdr.to = 0; //hard coded to 0 for testing
-  outMailHdr.to = 0;
-  outMailHdr.from = 1;
-  outMailHdr.length = strlen(buffer) + 1;
-
-  bool success = postOffice->Send(outPktHdr, outMailHdr, buffer);
-
-  if(!success) {
-    printf("The postOffice Send failed.\n");
-    interrupt->Halt();
-  }
-
-  
-  postOffice->Receive(myClientNum, &inPktHdr, &inMailHdr, buffer);
-  printf("Got \"%s\" from %d, box %d\n",buffer,inPktHdr.from,inMailHdr.from);
-  fflush(stdout);
-
-  //ss.str(buffer);
-  //int lockID_rec;
-  //ss>>lockID_rec;
-
-
-}
-
-RequestType getRequestType(char* req) {
-  
-  if(strcmp(req, "L")==0) {
-    return CREATE_LOCK;
-  } else if(strcmp(req, "A")==0) {
-    return ACQUIRE;
-  } else if (strcmp(req, "R")==0) {
-    return RELEASE;
-  } else if (strcmp(req, "D")==0) {
-    return DESTROY_LOCK;
-  } else if (strcmp(req, "C")==0) {
-    return CREATE_CONDITION;
-  } else if (strcmp(req, "W")==0) {
-    return WAIT;
-  } else if (strcmp(req, "S")==0) {
-    return SIGNAL;
-  } else if (strcmp(req, "B")==0) {
-    return BROADCAST;
-  } else if (strcmp(req, "J")==0) {
-    return REGISTER;
-  } else if (strcmp(req, "CMV")==0) {
-    return CREATE_MV;
-  } else if (strcmp(req, "GMV")==0) {
-    return GET;
-  } else if (strcmp(req, "SMV")==0) {
-    return SET;
-  } else {
-    return UNKNOWN;
-  }
+  TestRequest(&request, NULL);
 
 }
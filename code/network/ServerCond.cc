@@ -8,7 +8,6 @@ ServerCond::ServerCond() {
 
 ServerCond::ServerCond(int theCondID) {
   CondWaitQueueLock = new Lock("Wait Q Lock");
-  condWaitQueueSize = 0;
   condLockID = -1;
 }
 
@@ -16,16 +15,14 @@ void ServerCond::Wait(CondOwner theOwner) {
   
   CondWaitQueueLock->Acquire();
 
-  int waitQIndex = condWaitQueueSize;
-
   //put caller on the wait queue
-  condWaitQueue[waitQIndex].machineID = theOwner.machineID;
-  condWaitQueue[waitQIndex].mailboxNum = theOwner.mailboxNum;
-  //condWaitQueue[waitQIndex].lockID = theOwner.lockID;
+  LockOwner waiter;
+  waiter.machineID = theOwner.machineID;
+  waiter.mailboxNum = theOwner.mailboxNum;
+  waiter.seq = theOwner.seq;
+  condWaitQueue.Append(waiter);
   condLockID = theOwner.lockID;
-  printf("WAIT[%d]: machine: %d, box: %d\n",waitQIndex,theOwner.machineID, theOwner.mailboxNum);
-  printf("WAIT[%d]:(from queue) machine: %d, box: %d\n",waitQIndex,condWaitQueue[waitQIndex].machineID, condWaitQueue[waitQIndex].mailboxNum);
-  condWaitQueueSize++;
+  DEBUG('n',"WAIT[%d]: machine: %d, box: %d\n",condWaitQueue.Size()-1,theOwner.machineID, theOwner.mailboxNum);
 
   CondWaitQueueLock->Release();
 
@@ -34,23 +31,16 @@ void ServerCond::Wait(CondOwner theOwner) {
 ClientAddr ServerCond::Signal(CondOwner theOwner) {
   
   CondWaitQueueLock->Acquire();
-  if(condWaitQueueSize > 0) {
-    //wait queue is not empty
+  LockOwner waiter;
+  if(condWaitQueue.Remove(waiter)) {
+    //wait queue was not empty
 
     ClientAddr clientToWake;
-    clientToWake.machineID = condWaitQueue[0].machineID;
-    clientToWake.mailboxNum = condWaitQueue[0].mailboxNum;
-
-    printf("SIGNAL(from queue): machine: %d, box: %d\n",condWaitQueue[0].machineID, condWaitQueue[0].mailboxNum);
+    clientToWake.machineID = waiter.machineID;
+    clientToWake.mailboxNum = waiter.mailboxNum;
+    clientToWake.seq = waiter.seq;
 
-     printf("SIGNAL: machine: %d, box: %d\n",clientToWake.machineID, clientToWake.mailboxNum);
-    //clientToWake.lockID = waitQueue[0].lockID;
-
-    //move the rest of the wait queue up one slot
-    for(int i = 1; i < condWaitQueueSize; i++) {
-      condWaitQueue[i-1] = condWaitQueue[i];
-    }
-    condWaitQueueSize--;
+    DEBUG('n',"SIGNAL: machine: %d, box: %d\n",clientToWake.machineID, clientToWake.mailboxNum);
 
     CondWaitQueueLock->Release();
 
@@ -62,51 +52,28 @@ ClientAddr ServerCond::Signal(CondOwner theOwner) {
     ClientAddr noOwner; 
     noOwner.machineID = -1;
     noOwner.mailboxNum = -1;
-    //noOwner.lockID = -1;
+    noOwner.seq = 0;
     return noOwner;
   }
 
 }
 
-ClientAddr* ServerCond::Broadcast() {
-  
-  
+void ServerCond::Broadcast(ServerQueue<LockOwner> &woken) {
 
+  //wake everyone: hand the whole wait queue over at once
   CondWaitQueueLock->Acquire();
-
-  ClientAddr *clientsToWake = new ClientAddr[condWaitQueueSize];
-  for(int i = 0; i < condWaitQueueSize; i++) {
-    clientsToWake[i] = condWaitQueue[i];
-  }
-  
+  DEBUG('n',"BROADCAST: waking %d\n",condWaitQueue.Size());
+  woken.TakeAll(condWaitQueue);
   CondWaitQueueLock->Release();
 
-  return clientsToWake;
-
 }
 
 void ServerCond::SendMsg(CondOwner theOwner, int msg) {
   
-  PacketHeader outPktHdr;
-  MailHeader outMailHdr;
-  char buffer[MaxMailSize];
-
-  outPktHdr.to = theOwner.machineID;
-  outMailHdr.to = theOwner.mailboxNum;
-
-  //outMailHdr.from = 0;
-
-  sprintf(buffer, "%d", msg);
+  //answer the owner's request with msg
+  Message reply(MSG_REPLY, msg);
+  reply.seq = theOwner.seq;
 
-  outMailHdr.length = strlen(buffer) + 1;
-
-  bool success = postOffice->Send(outPktHdr, outMailHdr, buffer);
-  if(!success) {
-    //sending response to client failed
-    printf("The postOffice Send failed. Terminating Nachos\n");
-    interrupt->Halt();
-  } else {
-    printf("Sent reponse to client\n");
-  }
+  SendMessage(&reply, theOwner.machineID, theOwner.mailboxNum, 0);
 
 }
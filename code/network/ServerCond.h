@@ -1,24 +1,23 @@
 //ServerCond.h
 
-int MAX_SERVER_CONDS = 100;
-
 struct CondOwner {
   int machineID;
   int mailboxNum;
   int lockID;
+  int seq; //of the Wait request
 };
 
 struct ClientAddr {
   int machineID;
   int mailboxNum;
+  int seq; //of the Wait request
 };
 
 class ServerCond {
 
  private:
   Lock *CondWaitQueueLock;
-  ClientAddr condWaitQueue[1000];
-  int condWaitQueueSize;
+  ServerQueue<LockOwner> condWaitQueue; //they get the lock back when woken
 
  public:
   //CondOwner owner;
@@ -33,7 +32,7 @@ class ServerCond {
   void Wait(CondOwner theOwner); //CondOwner contains the lockID
   ClientAddr Signal(CondOwner theOwner); //returns info about the caller to wake up
   
-  ClientAddr* Broadcast();
+  void Broadcast(ServerQueue<LockOwner> &woken); //moves every waiter to woken
 
   void SendMsg(CondOwner theOwner, int msg);
 
@@ -4,7 +4,6 @@
 
 ServerLock::ServerLock() {
   //state = FREE;
-  // waitQueueSize = 0;
   myLockID = -1;
   //toBeDestroyed = false;
 }
@@ -12,7 +11,6 @@ ServerLock::ServerLock() {
 ServerLock::ServerLock(int theLockID) {
   
   state = FREE;
-  waitQueueSize = 0;
   myLockID = theLockID;
   toBeDestroyed = false;
 
@@ -27,10 +25,9 @@ void ServerLock::Acquire(LockOwner theOwner) {
   
   WaitQueueLock->Acquire();
   
-  if(waitQueueSize > 0) {
+  if(!waitQueue.IsEmpty()) {
     //there is a wait queue for the lock, put info on queue
-    waitQueue[waitQueueSize] = theOwner;
-    waitQueueSize++;
+    waitQueue.Append(theOwner);
 
   } else {
     //no one waiting for the lock
@@ -47,8 +44,7 @@ void ServerLock::Acquire(LockOwner theOwner) {
       //no one else waiting for lock, but lock busy
       //put info on queue
 
-      waitQueue[waitQueueSize] = theOwner;
-      waitQueueSize++;
+      waitQueue.Append(theOwner);
 
     }
 
@@ -60,6 +56,25 @@ void ServerLock::Acquire(LockOwner theOwner) {
 
 }
 
+void ServerLock::AcquireAll(ServerQueue<LockOwner> &theOwners) {
+
+  //the same as an Acquire for each of theOwners, in order, but done in
+  //one go: if the lock is free the first one gets it, and the rest
+  //join the wait queue, without copying them one at a time.
+  //(The server doesn't make ServerLocks at the moment -- locks are
+  //tokens -- so nothing calls this yet; see MSG_CREATE_LOCK.)
+  WaitQueueLock->Acquire();
+
+  if(state == FREE && waitQueue.IsEmpty() && theOwners.Remove(owner)) {
+    state = BUSY;
+    SendMsg(owner, myLockID);
+  }
+  waitQueue.TakeAll(theOwners);
+
+  WaitQueueLock->Release();
+
+}
+
 void ServerLock::Release(LockOwner theOwner) {
   
   /* don't check ownership?
@@ -76,16 +91,9 @@ void ServerLock::Release(LockOwner theOwner) {
 
   //check if anyone is waiting to use this lock
   WaitQueueLock->Acquire();
-  if(waitQueueSize > 0) {
-    //someone waiting for lock
-    
-    //take the 1st person from the wait queue and make it the lock owner
-    owner = waitQueue[0];
-    //move anyone else in the wait queue up one slot
-    for(int i=1; i<waitQueueSize; i++) {
-      waitQueue[i-1] = waitQueue[i];
-    }
-    waitQueueSize--;
+  if(waitQueue.Remove(owner)) {
+    //someone was waiting for lock: the 1st person in the wait queue
+    //is now the lock owner
 
     WaitQueueLock->Release();
 
@@ -115,28 +123,11 @@ void ServerLock::Destroy() {
 
 void ServerLock::SendMsg(LockOwner theOwner, int msg) {
   
-  PacketHeader outPktHdr;
-  MailHeader outMailHdr;
-  char buffer[MaxMailSize];
-  
-  outPktHdr.to = theOwner.machineID;
-  outMailHdr.to = theOwner.mailboxNum;
-
-  //outMailHdr.from = 0;
-  
-  sprintf(buffer, "%d", msg);
+  //answer the owner's request with msg
+  Message reply(MSG_REPLY, msg);
+  reply.seq = theOwner.seq;
 
-  outMailHdr.length = strlen(buffer) + 1;
-
-  printf("About to Send response to client at machine %d, box %d. response=%s.\n",outPktHdr.to, outMailHdr.to,buffer);
-
-  bool success = postOffice->Send(outPktHdr, outMailHdr, buffer);
-  if(!success) {
-    //sending response to client failed
-    printf("The postOffice Send failed. Terminating Nachos\n");
-    interrupt->Halt();
-  } else {
-    printf("Sent response to client at machine %d, box %d. response=%s.\n",outPktHdr.to, outMailHdr.to,buffer);
-  }
+  DEBUG('n',"Sending response to client at machine %d, box %d. response=%d.\n",theOwner.machineID, theOwner.mailboxNum, msg);
+  SendMessage(&reply, theOwner.machineID, theOwner.mailboxNum, 0);
 
 }
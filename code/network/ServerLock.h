@@ -1,10 +1,11 @@
 //ServerLock.h
 
-int MAX_SERVER_LOCKS = 100; //the max number of server locks
+#include "ServerQueue.h"
 
 struct LockOwner {
   int machineID;
   int mailboxNum;
+  int seq; //of the request the reply answers
 };
 
 enum LockState { BUSY, FREE };
@@ -18,9 +19,8 @@ class ServerLock {
  public:
 
   LockOwner owner;
-  LockOwner waitQueue[1000];
+  ServerQueue<LockOwner> waitQueue;
   LockState state;
-  int waitQueueSize;
   int myLockID;
   bool toBeDestroyed;
 
@@ -28,6 +28,7 @@ class ServerLock {
   ServerLock(int theLockID);
   
   void Acquire(LockOwner theOwner);
+  void AcquireAll(ServerQueue<LockOwner> &theOwners); //queue them all at once
   void Release(LockOwner theOwner);
   void Destroy();
 
@@ -0,0 +1,94 @@
+//ServerQueue.h
+//A first-in first-out queue for the server's waiting clients. It is a
+//ring buffer that doubles when it fills, so there is no limit on how
+//many can wait, and adding or removing one never moves the others.
+
+#ifndef SERVERQUEUE_H
+#define SERVERQUEUE_H
+
+#define InitialServerQueueSize 8 //slots before the queue first grows
+
+template <class T>
+class ServerQueue {
+
+ private:
+  T *items;
+  int size; //slots in items
+  int first; //slot of the oldest item
+  int count; //items in the queue
+
+  void Grow();
+
+  ServerQueue(const ServerQueue<T> &); //not copyable
+  void operator=(const ServerQueue<T> &);
+
+ public:
+  ServerQueue() { items = NULL; size = first = count = 0; }
+  ~ServerQueue() { delete [] items; }
+
+  int Size() { return count; }
+  bool IsEmpty() { return count == 0; }
+
+  void Append(T item); //add item at the end
+  bool Remove(T &item); //take the oldest item; false if there is none
+  void TakeAll(ServerQueue<T> &from); //move all of from's items to the end
+};
+
+template <class T>
+void ServerQueue<T>::Grow() {
+  int newSize = (size == 0) ? InitialServerQueueSize : size * 2;
+  T *newItems = new T[newSize];
+
+  for(int i = 0; i < count; i++) {
+    newItems[i] = items[(first + i) % size];
+  }
+  delete [] items;
+  items = newItems;
+  size = newSize;
+  first = 0;
+}
+
+template <class T>
+void ServerQueue<T>::Append(T item) {
+  if(count == size) {
+    Grow();
+  }
+  items[(first + count) % size] = item;
+  count++;
+}
+
+template <class T>
+bool ServerQueue<T>::Remove(T &item) {
+  if(count == 0) {
+    return false;
+  }
+  item = items[first];
+  first = (first + 1) % size;
+  count--;
+  return true;
+}
+
+template <class T>
+void ServerQueue<T>::TakeAll(ServerQueue<T> &from) {
+  if(count == 0) {
+    //just swap the buffers
+    T *oldItems = items;
+    int oldSize = size;
+
+    items = from.items;
+    size = from.size;
+    first = from.first;
+    count = from.count;
+    from.items = oldItems;
+    from.size = oldSize;
+    from.first = from.count = 0;
+    return;
+  }
+
+  T item;
+  while(from.Remove(item)) {
+    Append(item);
+  }
+}
+
+#endif // SERVERQUEUE_H
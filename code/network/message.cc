@@ -0,0 +1,313 @@
+// message.cc
+//	Encoding and decoding of the fixed-layout messages between user
+//	programs, network threads and the Project 3 server.  See
+//	message.h for the layout.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "system.h"
+#include "message.h"
+
+static int nextSeq = 0;		// sequence number of the last request
+
+//----------------------------------------------------------------------
+// PutWord, GetWord, PutShort, GetShort
+//	Store and load big-endian integers, whatever the host's byte
+//	order is.
+//----------------------------------------------------------------------
+
+static void
+PutWord(char *p, int value)
+{
+    p[0] = (value >> 24) & 0xff;
+    p[1] = (value >> 16) & 0xff;
+    p[2] = (value >> 8) & 0xff;
+    p[3] = value & 0xff;
+}
+
+static int
+GetWord(char *p)
+{
+    return ((p[0] & 0xff) << 24) | ((p[1] & 0xff) << 16) |
+	   ((p[2] & 0xff) << 8) | (p[3] & 0xff);
+}
+
+static void
+PutShort(char *p, int value)
+{
+    p[0] = (value >> 8) & 0xff;
+    p[1] = value & 0xff;
+}
+
+static int
+GetShort(char *p)
+{
+    return (short) (((p[0] & 0xff) << 8) | (p[1] & 0xff));
+}
+
+//----------------------------------------------------------------------
+// Message::Message
+//	Initialize a message with no name or members.
+//----------------------------------------------------------------------
+
+Message::Message()
+{
+    op = 0;
+    seq = 0;
+    arg1 = arg2 = 0;
+    name[0] = '\0';
+    numMembers = 0;
+    numItems = 0;
+}
+
+Message::Message(int theOp, int theArg1, int theArg2)
+{
+    op = theOp;
+    seq = 0;
+    arg1 = theArg1;
+    arg2 = theArg2;
+    name[0] = '\0';
+    numMembers = 0;
+    numItems = 0;
+}
+
+//----------------------------------------------------------------------
+// Message::Encode
+//	Write the message into "buffer", which must hold 
+//	MaxMessageLength bytes.  Returns the number of bytes written.
+//	Only the create requests carry the name, only MSG_MEMBERS and
+//	the forwarded lock requests the member pairs, and only batches
+//	and replies the items.
+//----------------------------------------------------------------------
+
+int
+Message::Encode(char *buffer)
+{
+    int length = MessageHeaderSize;
+    int i;
+
+    PutWord(buffer, op);
+    PutWord(buffer + 4, seq);
+    PutWord(buffer + 8, arg1);
+    PutWord(buffer + 12, arg2);
+
+    if (op == MSG_CREATE_LOCK || op == MSG_CREATE_MV) {
+	for (i = 0; i < MessageNameSize && name[i] != '\0'; i++)
+	    buffer[length++] = name[i];
+    } else if (op == MSG_MEMBERS || op == MSG_ACQUIRE_FOR ||
+	       op == MSG_RELEASE_FOR) {
+	ASSERT(numMembers <= MaxMessageMembers);
+	for (i = 0; i < numMembers; i++) {
+	    PutShort(buffer + length, memberMachine[i]);
+	    PutShort(buffer + length + 2, memberMailbox[i]);
+	    length += 4;
+	}
+    } else if (op == MSG_BATCH || op == MSG_REPLY) {
+	ASSERT(numItems <= MaxBatchItems);
+	for (i = 0; i < numItems; i++) {
+	    PutWord(buffer + length, itemOp[i]);
+	    PutWord(buffer + length + 4, itemArg1[i]);
+	    PutWord(buffer + length + 8, itemArg2[i]);
+	    length += 12;
+	}
+    }
+    return length;
+}
+
+//----------------------------------------------------------------------
+// Message::Decode
+//	Read a message back out of the "length" bytes in "buffer".
+//	Returns FALSE, leaving the message undefined, if it is too short
+//	or has an unknown op.
+//----------------------------------------------------------------------
+
+bool
+Message::Decode(char *buffer, int length)
+{
+    int i, n;
+
+    if (length < MessageHeaderSize || length > MaxMessageLength)
+	return FALSE;
+    op = GetWord(buffer);
+    seq = GetWord(buffer + 4);
+    arg1 = GetWord(buffer + 8);
+    arg2 = GetWord(buffer + 12);
+    if (op < 1 || op > NumMessageOps)
+	return FALSE;
+
+    n = length - MessageHeaderSize;
+    name[0] = '\0';
+    numMembers = 0;
+    numItems = 0;
+    if (op == MSG_CREATE_LOCK || op == MSG_CREATE_MV) {
+	if (n > MessageNameSize)
+	    n = MessageNameSize;
+	for (i = 0; i < n; i++)
+	    name[i] = buffer[MessageHeaderSize + i];
+	name[n] = '\0';
+    } else if (op == MSG_MEMBERS || op == MSG_ACQUIRE_FOR ||
+	       op == MSG_RELEASE_FOR) {
+	numMembers = n / 4;
+	if (numMembers > MaxMessageMembers)
+	    numMembers = MaxMessageMembers;
+	for (i = 0; i < numMembers; i++) {
+	    memberMachine[i] = GetShort(buffer + MessageHeaderSize + 4 * i);
+	    memberMailbox[i] = GetShort(buffer + MessageHeaderSize + 4 * i + 2);
+	}
+    } else if (op == MSG_BATCH || op == MSG_REPLY) {
+	numItems = n / 12;
+	for (i = 0; i < numItems; i++) {
+	    itemOp[i] = GetWord(buffer + MessageHeaderSize + 12 * i);
+	    itemArg1[i] = GetWord(buffer + MessageHeaderSize + 12 * i + 4);
+	    itemArg2[i] = GetWord(buffer + MessageHeaderSize + 12 * i + 8);
+	}
+    }
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// NextMessageSeq
+//	Return a sequence number for a new request.
+//----------------------------------------------------------------------
+
+int
+NextMessageSeq()
+{
+    return ++nextSeq;
+}
+
+//----------------------------------------------------------------------
+// HashName
+//	Hash a lock or MV name (djb2).
+//----------------------------------------------------------------------
+
+unsigned int
+HashName(const char *name)
+{
+    unsigned int hash = 5381;
+
+    for (; *name != '\0'; name++)
+	hash = hash * 33 + (unsigned char) *name;
+    return hash;
+}
+
+//----------------------------------------------------------------------
+// ServerForName
+//	Return the server that owns the name "name".  Each of the
+//	"numServers" servers owns an equal, contiguous range of the top
+//	16 bits of the name's hash.
+//----------------------------------------------------------------------
+
+int
+ServerForName(const char *name)
+{
+    return ((HashName(name) >> 16) * numServers) >> 16;
+}
+
+//----------------------------------------------------------------------
+// ServerForId
+//	Return the server that handed out the ID "id".  Bad IDs go to
+//	server 0, which rejects them.
+//----------------------------------------------------------------------
+
+int
+ServerForId(int id)
+{
+    if (id < 0)
+	return 0;
+    return id % numServers;
+}
+
+//----------------------------------------------------------------------
+// SendMessage
+//	Encode "msg" straight into the outgoing mail buffer and send it
+//	from mailbox "fromBox" to mailbox "box" on "toMachine".
+//----------------------------------------------------------------------
+
+void
+SendMessage(Message *msg, int toMachine, int box, int fromBox)
+{
+    PacketHeader outPktHdr;
+    MailHeader outMailHdr;
+    char buffer[MaxMessageLength];
+
+    outPktHdr.to = toMachine;
+    outMailHdr.to = box;
+    outMailHdr.from = fromBox;
+    outMailHdr.length = msg->Encode(buffer);
+
+    DEBUG('n', "Sending op %d seq %d (%d, %d) to %d, box %d\n", msg->op,
+	msg->seq, msg->arg1, msg->arg2, toMachine, box);
+    if (!postOffice->Send(outPktHdr, outMailHdr, buffer)) {
+	printf("The postOffice Send failed. Terminating Nachos.\n");
+	interrupt->Halt();
+    }
+}
+
+//----------------------------------------------------------------------
+// SendReply
+//	Reply to "request", echoing its sequence number.
+//----------------------------------------------------------------------
+
+void
+SendReply(Message *request, int arg1, int arg2, int toMachine, int box,
+	int fromBox)
+{
+    Message reply(MSG_REPLY, arg1, arg2);
+
+    reply.seq = request->seq;
+    SendMessage(&reply, toMachine, box, fromBox);
+}
+
+//----------------------------------------------------------------------
+// ReceiveMessage
+//	Wait for a well-formed message to arrive in mailbox "box", and
+//	decode it into "msg".  The headers it came with are returned in
+//	"pktHdr" and "mailHdr".
+//----------------------------------------------------------------------
+
+void
+ReceiveMessage(int box, Message *msg, PacketHeader *pktHdr,
+	MailHeader *mailHdr)
+{
+    char buffer[MaxMessageLength];	// anything longer won't decode
+
+    for (;;) {
+	postOffice->Receive(box, pktHdr, mailHdr, buffer, MaxMessageLength);
+	if (msg->Decode(buffer, mailHdr->length))
+	    break;
+	DEBUG('n', "Dropping malformed message from %d, box %d\n",
+	    pktHdr->from, mailHdr->from);
+    }
+    DEBUG('n', "Got op %d seq %d (%d, %d) from %d, box %d\n", msg->op,
+	msg->seq, msg->arg1, msg->arg2, pktHdr->from, mailHdr->from);
+}
+
+//----------------------------------------------------------------------
+// TryReceiveMessage
+//	Like ReceiveMessage, but if no well-formed message is waiting in
+//	mailbox "box", return FALSE at once.
+//----------------------------------------------------------------------
+
+bool
+TryReceiveMessage(int box, Message *msg, PacketHeader *pktHdr,
+	MailHeader *mailHdr)
+{
+    char buffer[MaxMessageLength];	// anything longer won't decode
+
+    while (postOffice->TryReceive(box, pktHdr, mailHdr, buffer,
+				MaxMessageLength)) {
+	if (msg->Decode(buffer, mailHdr->length)) {
+	    DEBUG('n', "Got op %d seq %d (%d, %d) from %d, box %d\n",
+		msg->op, msg->seq, msg->arg1, msg->arg2, pktHdr->from,
+		mailHdr->from);
+	    return TRUE;
+	}
+	DEBUG('n', "Dropping malformed message from %d, box %d\n",
+	    pktHdr->from, mailHdr->from);
+    }
+    return FALSE;
+}
@@ -0,0 +1,127 @@
+// message.h
+//	The requests and replies that user programs, their network
+//	threads and the Project 3 lock/condition/MV server send each
+//	other.
+//
+//	Every message has the same fixed layout: four 32-bit fields in
+//	network byte order,
+//
+//		op | seq | arg1 | arg2
+//
+//	followed by a name, for the create requests, by (machine,
+//	mailbox) pairs of 16-bit fields, for the member list, or by
+//	(op, arg1, arg2) items of 32-bit fields, for a batch of requests
+//	and the reply to it.  What arg1 and arg2 hold depends on op (see
+//	MessageOp below).  Each request carries a sequence number, and
+//	the reply to it echoes it back.
+//
+//	Encode and Decode work directly on the caller's mail buffer, so
+//	sending or receiving a message allocates nothing and parses no
+//	text, on either side.
+//
+//	The objects can be spread over "numServers" servers, on machines 
+//	0 to numServers - 1.  Each one owns a range of name hashes, and
+//	the IDs it hands out say which server made them, so a client can
+//	send any request straight to the server that owns the object.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef MESSAGE_H
+#define MESSAGE_H
+
+#include "post.h"
+
+enum MessageOp {
+    MSG_CREATE_LOCK = 1,	// name -> REPLY(token id, 1 if it existed)
+    MSG_DESTROY_LOCK,		// arg1 = lock id
+    MSG_ACQUIRE,		// arg1 = lock id -> REPLY(lock id)
+    MSG_RELEASE,		// arg1 = lock id -> REPLY(lock id)
+    MSG_CREATE_COND,		// -> REPLY(condition id)
+    MSG_WAIT,			// arg1 = condition id, arg2 = lock id
+    MSG_SIGNAL,			// arg1 = condition id, arg2 = lock id
+    MSG_BROADCAST,		// arg1 = condition id, arg2 = lock id
+    MSG_REGISTER,		// join the group
+    MSG_MEMBERS,		// arg1 = group size, arg2 = index of the
+				// first member in this message
+    MSG_REGISTERED,		// the group is complete
+    MSG_CREATE_MV,		// name -> REPLY(MV id)
+    MSG_GET_MV,			// arg1 = MV id -> REPLY(value)
+    MSG_SET_MV,			// arg1 = MV id, arg2 = value
+    MSG_BATCH,			// arg1 = number of items, each a GET_MV or
+				// SET_MV -> REPLY(number of items, with
+				// each one's value in its arg1)
+    MSG_ACQUIRE_FOR,		// arg1 = lock id; between servers: acquire
+    MSG_RELEASE_FOR,		// or release it for the client in the
+				// (one) member pair, answering it directly
+    MSG_TOKEN,			// arg1 = token id
+    MSG_REPLY			// arg1 = result, arg2 = extra result
+};
+
+#define NumMessageOps		MSG_REPLY
+
+#define MessageHeaderSize	16	// op, seq, arg1, arg2
+#define MessageNameSize		16	// longest name in a create request
+#define MaxMessageMembers	64	// in one MSG_MEMBERS message
+#define MaxBatchItems		32	// in one MSG_BATCH message
+#define MaxMessageLength	(MessageHeaderSize + 12 * MaxBatchItems)
+					// a full batch is the longest
+
+#define MessageError		-3	// arg1 of a reply to a bad request
+
+class Message {
+  public:
+    Message();				// an empty message
+    Message(int op, int arg1 = 0, int arg2 = 0);
+
+    int op;				// a MessageOp
+    int seq;				// matches replies to requests
+    int arg1, arg2;
+    char name[MessageNameSize + 1];	// create requests; NUL terminated
+    int numMembers;			// MSG_MEMBERS: pairs that follow
+    int memberMachine[MaxMessageMembers];
+    int memberMailbox[MaxMessageMembers];
+    int numItems;			// MSG_BATCH and its reply: items
+    int itemOp[MaxBatchItems];		// that follow
+    int itemArg1[MaxBatchItems];
+    int itemArg2[MaxBatchItems];
+
+    int Encode(char *buffer);		// write the message into buffer
+					// and return its length
+    bool Decode(char *buffer, int length); // read the message back;
+					// FALSE if it is malformed
+};
+
+// Start a new request: give it the next sequence number
+extern int NextMessageSeq();
+
+// Which server owns the object called "name", or with ID "id"
+extern unsigned int HashName(const char *name);
+extern int ServerForName(const char *name);
+extern int ServerForId(int id);
+
+// The ID of the object at "index" in "server"'s tables, and back
+#define ServerId(index, server)	((index) * numServers + (server))
+#define ServerIndex(id)		((id) / numServers)
+
+// Encode "msg" and mail it from "fromBox" to (toMachine, box).  Nachos
+// halts if the network won't take it.
+extern void SendMessage(Message *msg, int toMachine, int box, int fromBox);
+
+// Send the reply to "request" with results arg1 and arg2
+extern void SendReply(Message *request, int arg1, int arg2, int toMachine,
+			int box, int fromBox);
+
+// Wait for a message in mailbox "box" and decode it into "msg".
+// Malformed messages are dropped.
+extern void ReceiveMessage(int box, Message *msg, PacketHeader *pktHdr,
+			MailHeader *mailHdr);
+
+// The same, but return FALSE instead of waiting if there is none
+extern bool TryReceiveMessage(int box, Message *msg, PacketHeader *pktHdr,
+			MailHeader *mailHdr);
+
+#endif // MESSAGE_H
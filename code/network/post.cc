@@ -12,12 +12,26 @@
 // 	The implementation synchronizes incoming messages with threads
 //	waiting for those messages.
 //
+//	Delivery is made reliable with a sliding window between each 
+//	pair of mailboxes.  Messages are numbered; the receiver delivers
+//	them in order, drops the rest, and acknowledges what it has 
+//	delivered so far.  The sender keeps up to WindowSize messages 
+//	that have not been acknowledged, and resends them all when 
+//	RetransmitTime passes without an acknowledgement (go-back-N).
+//
+//	Messages longer than a packet are sent as a run of fragments,
+//	each numbered like any other packet.  Since fragments arrive in
+//	order, the receiver just appends them to the connection's 
+//	reassembly buffer until the last one, and then delivers the whole
+//	message.
+//
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
 // of liability and disclaimer of warranty provisions.
 
 #include "copyright.h"
 #include "post.h"
+#include "system.h"
 
 extern "C" {
 	int bcopy(char *, char *, int);
@@ -39,7 +53,80 @@ Mail::Mail(PacketHeader pktH, MailHeader mailH, char *msgData)
 
     pktHdr = pktH;
     mailHdr = mailH;
-    bcopy(msgData, data, mailHdr.length);
+    data = new char[mailHdr.length + 1];
+    if (mailHdr.length > 0)
+	bcopy(msgData, data, mailHdr.length);
+}
+
+//----------------------------------------------------------------------
+// Mail::~Mail
+//      De-allocate a mail message.
+//----------------------------------------------------------------------
+
+Mail::~Mail()
+{
+    delete [] data;
+}
+
+//----------------------------------------------------------------------
+// Connection::Connection
+//      Initialize the state of the conversation between "local" and
+//	mailbox "remote" on "toMachine".  Both directions start at 
+//	sequence number 0.
+//----------------------------------------------------------------------
+
+Connection::Connection(MailBoxAddress local, NetworkAddress toMachine,
+		MailBoxAddress remote)
+{
+    localBox = local;
+    remoteMachine = toMachine;
+    remoteBox = remote;
+    nextSeq = firstUnacked = expectedSeq = 0;
+    for (int i = 0; i < WindowSize; i++)
+	window[i] = NULL;
+    lastSent = 0;
+    windowOpen = new Condition("window open");
+    reassembly = NULL;
+    reassembled = 0;
+    sendLock = new Lock("connection send lock");
+    discarding = FALSE;
+    remoteEpoch = 0;
+    next = NULL;
+}
+
+//----------------------------------------------------------------------
+// Connection::Reset
+//      Start the conversation over, because the other end has been
+//	restarted and numbers its messages from 0 again.  Messages
+//	still waiting for an ack were meant for the old incarnation,
+//	so they are thrown away, as is a half received message.
+//----------------------------------------------------------------------
+
+void
+Connection::Reset()
+{
+    for (int i = 0; i < WindowSize; i++) {
+	delete window[i];
+	window[i] = NULL;
+    }
+    nextSeq = firstUnacked = expectedSeq = 0;
+    reassembled = 0;
+    discarding = FALSE;
+}
+
+//----------------------------------------------------------------------
+// Connection::~Connection
+//      De-allocate a connection, and any messages still waiting for
+//	an acknowledgement.
+//----------------------------------------------------------------------
+
+Connection::~Connection()
+{
+    for (int i = 0; i < WindowSize; i++)
+	delete window[i];
+    delete windowOpen;
+    delete [] reassembly;
+    delete sendLock;
 }
 
 //----------------------------------------------------------------------
@@ -118,22 +205,58 @@ MailBox::Put(PacketHeader pktHdr, MailHeader mailHdr, char *data)
 //	"pktHdr" -- address to put: source, destination machine ID's
 //	"mailHdr" -- address to put: source, destination mailbox ID's
 //	"data" -- address to put: payload message data
+//	"size" -- the most bytes of it "data" can hold
 //----------------------------------------------------------------------
 
 void 
-MailBox::Get(PacketHeader *pktHdr, MailHeader *mailHdr, char *data) 
+MailBox::Get(PacketHeader *pktHdr, MailHeader *mailHdr, char *data,
+		int size) 
 { 
     DEBUG('n', "Waiting for mail in mailbox\n");
     Mail *mail = (Mail *) messages->Remove();	// remove message from list;
 						// will wait if list is empty
 
+    CopyOut(mail, pktHdr, mailHdr, data, size);
+}
+
+//----------------------------------------------------------------------
+// MailBox::TryGet
+// 	Get a message from a mailbox, like MailBox::Get, if there is one
+//	there.  Returns FALSE, without waiting, if there isn't.
+//----------------------------------------------------------------------
+
+bool 
+MailBox::TryGet(PacketHeader *pktHdr, MailHeader *mailHdr, char *data,
+		int size) 
+{ 
+    Mail *mail = (Mail *) messages->TryRemove();
+
+    if (mail == NULL)
+	return FALSE;
+    CopyOut(mail, pktHdr, mailHdr, data, size);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// MailBox::CopyOut
+// 	Parse a message taken out of the mailbox into the packet header,
+//	mailbox header, and data, and discard it.  Data past the first
+//	"size" bytes is dropped; mailHdr->length still says how long the
+//	message was.
+//----------------------------------------------------------------------
+
+void 
+MailBox::CopyOut(Mail *mail, PacketHeader *pktHdr, MailHeader *mailHdr,
+		char *data, int size) 
+{ 
     *pktHdr = mail->pktHdr;
     *mailHdr = mail->mailHdr;
     if (DebugIsEnabled('n')) {
 	printf("Got mail from mailbox: ");
 	PrintHeader(*pktHdr, *mailHdr);
     }
-    bcopy(mail->data, data, mail->mailHdr.length);
+    bcopy(mail->data, data, (mail->mailHdr.length < size) ? 
+			mail->mailHdr.length : size);
 					// copy the message data into
 					// the caller's buffer
     delete mail;			// we've copied out the stuff we
@@ -143,8 +266,9 @@ MailBox::Get(PacketHeader *pktHdr, MailHeader *mailHdr, char *data)
 //----------------------------------------------------------------------
 // PostalHelper, ReadAvail, WriteDone
 // 	Dummy functions because C++ can't indirectly invoke member functions
-//	The first is forked as part of the "postal worker thread; the
-//	later two are called by the network interrupt handler.
+//	The first is forked as part of the "postal worker thread, and
+//	RetransmitHelper as the "retransmitter" thread; the others
+//	are called by the network and timer interrupt handlers.
 //
 //	"arg" -- pointer to the Post Office managing the Network
 //----------------------------------------------------------------------
@@ -155,6 +279,10 @@ static void ReadAvail(int arg)
 { PostOffice* po = (PostOffice *) arg; po->IncomingPacket(); }
 static void WriteDone(int arg)
 { PostOffice* po = (PostOffice *) arg; po->PacketSent(); }
+static void RetransmitHelper(int arg)
+{ PostOffice* po = (PostOffice *) arg; po->Retransmit(); }
+static void RetransmitAlarm(int arg)
+{ PostOffice* po = (PostOffice *) arg; po->RetransmitTimeout(); }
 
 //----------------------------------------------------------------------
 // PostOffice::PostOffice
@@ -179,11 +307,19 @@ PostOffice::PostOffice(NetworkAddress addr, double reliability, int nBoxes)
 {
 // First, initialize the synchronization with the interrupt handlers
     messageAvailable = new Semaphore("message available", 0);
-    messageSent = new Semaphore("message sent", 0);
-    sendLock = new Lock("message send lock");
+    outgoing = new List();
+    networkBusy = FALSE;
+    retransmitWanted = new Semaphore("retransmit wanted", 0);
+    timerPending = FALSE;
+
+// Then the table of conversations with other mailboxes
+    connectionLock = new Lock("connection lock");
+    for (int i = 0; i < ConnectionBuckets; i++)
+	connections[i] = NULL;
 
 // Second, initialize the mailboxes
     netAddr = addr; 
+    epoch = Incarnation();
     numBoxes = nBoxes;
     boxes = new MailBox[nBoxes];
 
@@ -196,6 +332,10 @@ PostOffice::PostOffice(NetworkAddress addr, double reliability, int nBoxes)
     Thread *t = new Thread("postal worker");
 
     t->Fork(PostalHelper, (int) this);
+
+// and another to resend what the network loses.
+    t = new Thread("retransmitter");
+    t->Fork(RetransmitHelper, (int) this);
 }
 
 //----------------------------------------------------------------------
@@ -208,8 +348,47 @@ PostOffice::~PostOffice()
     delete network;
     delete [] boxes;
     delete messageAvailable;
-    delete messageSent;
-    delete sendLock;
+    while (!outgoing->IsEmpty())
+	delete (Mail *) outgoing->Remove();
+    delete outgoing;
+    for (int i = 0; i < ConnectionBuckets; i++) {
+	while (connections[i] != NULL) {
+	    Connection *conn = connections[i];
+	    connections[i] = conn->next;
+	    delete conn;
+	}
+    }
+    delete connectionLock;
+    delete retransmitWanted;
+}
+
+//----------------------------------------------------------------------
+// PostOffice::FindConnection
+// 	Return the conversation between "localBox" and mailbox "remoteBox"
+//	on "remoteMachine", starting a new one if there isn't one.
+//
+//	The caller must hold connectionLock.
+//----------------------------------------------------------------------
+
+Connection *
+PostOffice::FindConnection(MailBoxAddress localBox, 
+		NetworkAddress remoteMachine, MailBoxAddress remoteBox)
+{
+    unsigned bucket = ((unsigned) remoteMachine * 31 * 31 + 
+		(unsigned) remoteBox * 31 + (unsigned) localBox) 
+		% ConnectionBuckets;
+    Connection *conn;
+
+    for (conn = connections[bucket]; conn != NULL; conn = conn->next)
+	if (conn->localBox == localBox && 
+		conn->remoteMachine == remoteMachine &&
+		conn->remoteBox == remoteBox)
+	    return conn;
+
+    conn = new Connection(localBox, remoteMachine, remoteBox);
+    conn->next = connections[bucket];
+    connections[bucket] = conn;
+    return conn;
 }
 
 //----------------------------------------------------------------------
@@ -240,20 +419,167 @@ PostOffice::PostalDelivery()
 
 	// check that arriving message is legal!
 	ASSERT(0 <= mailHdr.to && mailHdr.to < numBoxes);
-	ASSERT(mailHdr.length <= MaxMailSize);
+	ASSERT(mailHdr.length <= MaxFragmentSize);
+
+	connectionLock->Acquire();
+	Connection *conn = FindConnection(mailHdr.to, pktHdr.from, 
+					mailHdr.from);
+
+	// a new incarnation at the other end starts over from seq 0,
+	// so we have to as well
+	if (conn->remoteEpoch != mailHdr.epoch) {
+	    if (conn->remoteEpoch != 0) {
+		DEBUG('n', "(%d, %d) restarted, resetting the connection\n",
+			pktHdr.from, mailHdr.from);
+		conn->Reset();
+		conn->windowOpen->Broadcast(connectionLock);
+	    }
+	    conn->remoteEpoch = mailHdr.epoch;
+	}
+
+	// every packet acknowledges the messages before its "ack"
+	if (mailHdr.ack > conn->firstUnacked && 
+		mailHdr.ack <= conn->nextSeq) {
+	    while (conn->firstUnacked < mailHdr.ack) {
+		delete conn->window[conn->firstUnacked % WindowSize];
+		conn->window[conn->firstUnacked % WindowSize] = NULL;
+		conn->firstUnacked++;
+	    }
+	    conn->lastSent = stats->totalTicks;
+	    conn->windowOpen->Broadcast(connectionLock);
+	}
+
+	// deliver messages in order; anything else is a duplicate, or
+	// will be resent once the ones before it get through
+	bool inOrder = (mailHdr.seq != NoSeq && 
+				mailHdr.seq == conn->expectedSeq);
+	bool deliver = inOrder;
+	char *data = buffer + sizeof(MailHeader);
+	if (deliver) {
+	    conn->expectedSeq++;
+
+	    // put the fragments of a long message back together; one too
+	    // long to fit is thrown away, rather than trusting the sender
+	    if (conn->discarding || 
+			conn->reassembled + mailHdr.length > MaxMailSize) {
+		if (!conn->discarding)
+		    DEBUG('n', "Dropping a message over %d bytes\n", 
+					MaxMailSize);
+		conn->reassembled = 0;
+		conn->discarding = mailHdr.more;
+		deliver = FALSE;
+	    } else if (mailHdr.more || conn->reassembled > 0) {
+		if (conn->reassembly == NULL)
+		    conn->reassembly = new char[MaxMailSize];
+		bcopy(data, conn->reassembly + conn->reassembled, 
+					mailHdr.length);
+		conn->reassembled += mailHdr.length;
+		if (mailHdr.more) {
+		    deliver = FALSE;	// wait for the rest
+		} else {
+		    data = conn->reassembly;
+		    mailHdr.length = conn->reassembled;
+		    conn->reassembled = 0;
+		}
+	    }
+	}
+
+	PacketHeader ackPktHdr;
+	MailHeader ackHdr;
+	ackPktHdr.to = pktHdr.from;
+	ackHdr.to = mailHdr.from;
+	ackHdr.from = mailHdr.to;
+	ackHdr.length = 0;
+	ackHdr.more = FALSE;
+	ackHdr.seq = NoSeq;
+	ackHdr.ack = conn->expectedSeq;
+	connectionLock->Release();
+
+	// put into mailbox; only this thread touches the reassembly 
+	// buffer, so it can still be copied from outside the lock
+	if (deliver)
+	    boxes[mailHdr.to].Put(pktHdr, mailHdr, data);
+	else if (mailHdr.seq != NoSeq && !inOrder)
+	    DEBUG('n', "Dropping message %d, expecting %d\n", mailHdr.seq,
+					ackHdr.ack);
+
+	// acknowledge every message, even one we have already seen, in
+	// case the ack for it was lost
+	if (mailHdr.seq != NoSeq)
+	    SendPacket(ackPktHdr, ackHdr, NULL);
+    }
+}
 
-	// put into mailbox
-        boxes[mailHdr.to].Put(pktHdr, mailHdr, buffer + sizeof(MailHeader));
+//----------------------------------------------------------------------
+// PostOffice::Retransmit
+// 	Each time the retransmit timer goes off, resend the window of
+//	every conversation that has gone RetransmitTime without an
+//	acknowledgement.  Keep the timer going while any messages are
+//	unacknowledged.
+//----------------------------------------------------------------------
+
+void
+PostOffice::Retransmit()
+{
+    for (;;) {
+	retransmitWanted->P();
+
+	bool outstanding = FALSE;
+	connectionLock->Acquire();
+	for (int i = 0; i < ConnectionBuckets; i++) {
+	    for (Connection *conn = connections[i]; conn != NULL; 
+			conn = conn->next) {
+		if (conn->firstUnacked == conn->nextSeq)
+		    continue;
+		outstanding = TRUE;
+		if (stats->totalTicks - conn->lastSent < RetransmitTime)
+		    continue;
+
+		DEBUG('n', "Resending messages %d to %d to (%d, %d)\n",
+			conn->firstUnacked, conn->nextSeq - 1,
+			conn->remoteMachine, conn->remoteBox);
+		for (int seq = conn->firstUnacked; seq < conn->nextSeq; seq++) {
+		    Mail *mail = conn->window[seq % WindowSize];
+
+		    mail->mailHdr.ack = conn->expectedSeq;
+		    SendPacket(mail->pktHdr, mail->mailHdr, mail->data);
+		    stats->numRetransmits++;
+		}
+		conn->lastSent = stats->totalTicks;
+	    }
+	}
+	connectionLock->Release();
+
+	if (outstanding)
+	    StartRetransmitTimer();
     }
 }
 
+//----------------------------------------------------------------------
+// PostOffice::StartRetransmitTimer
+// 	Arrange for the retransmitter to look for lost messages 
+//	RetransmitTime from now, unless it already will.
+//----------------------------------------------------------------------
+
+void
+PostOffice::StartRetransmitTimer()
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    if (!timerPending) {
+	timerPending = TRUE;
+	interrupt->Schedule(RetransmitAlarm, (int) this, RetransmitTime,
+				NetworkTimerInt);
+    }
+    (void) interrupt->SetLevel(oldLevel);
+}
+
 //----------------------------------------------------------------------
 // PostOffice::Send
-// 	Concatenate the MailHeader to the front of the data, and pass 
-//	the result to the Network for delivery to the destination machine.
-//
-//	Note that the MailHeader + data looks just like normal payload
-//	data to the Network.
+// 	Split the message into fragments that fit in a packet, and for
+//	each one: number it, keep a copy of it until it is acknowledged,
+//	and put it on the network.  If WindowSize earlier packets to the 
+//	same mailbox are still unacknowledged, wait for an ack first.
 //
 //	"pktHdr" -- source, destination machine ID's
 //	"mailHdr" -- source, destination mailbox ID's
@@ -263,39 +589,108 @@ PostOffice::PostalDelivery()
 bool
 PostOffice::Send(PacketHeader pktHdr, MailHeader mailHdr, char* data)
 {
-    char* buffer = new char[MaxPacketSize];	// space to hold concatenated
-						// mailHdr + data
+    ASSERT(mailHdr.length <= MaxMailSize);
+    ASSERT(0 <= mailHdr.to && mailHdr.to < numBoxes);
 
+    connectionLock->Acquire();
+    Connection *conn = FindConnection(mailHdr.from, pktHdr.to, mailHdr.to);
+    connectionLock->Release();
+
+    conn->sendLock->Acquire();
+    connectionLock->Acquire();
+    unsigned offset = 0;
+    MailHeader fragHdr = mailHdr;
+    do {
+	while (conn->nextSeq - conn->firstUnacked >= WindowSize)
+	    conn->windowOpen->Wait(connectionLock);
+
+	fragHdr.length = mailHdr.length - offset;
+	if (fragHdr.length > MaxFragmentSize)
+	    fragHdr.length = MaxFragmentSize;
+	fragHdr.more = (offset + fragHdr.length < mailHdr.length);
+	fragHdr.seq = conn->nextSeq++;
+	fragHdr.ack = conn->expectedSeq;
+	if (conn->firstUnacked == fragHdr.seq)
+	    conn->lastSent = stats->totalTicks;
+	conn->window[fragHdr.seq % WindowSize] = 
+				new Mail(pktHdr, fragHdr, data + offset);
+	SendPacket(pktHdr, fragHdr, data + offset);
+	offset += fragHdr.length;
+    } while (offset < mailHdr.length);
+    connectionLock->Release();
+    conn->sendLock->Release();
+
+    StartRetransmitTimer();
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// PostOffice::SendPacket
+// 	Queue a packet for the Network, and start sending it if the 
+//	network is idle.  Returns without waiting for the packet to go
+//	out; PacketSent hands the network each following packet as the 
+//	one before it is done.  The network may drop it.
+//
+//	"pktHdr" -- source, destination machine ID's
+//	"mailHdr" -- source, destination mailbox ID's
+//	"data" -- payload message data
+//----------------------------------------------------------------------
+
+void
+PostOffice::SendPacket(PacketHeader pktHdr, MailHeader mailHdr, char* data)
+{
     if (DebugIsEnabled('n')) {
 	printf("Post send: ");
 	PrintHeader(pktHdr, mailHdr);
     }
 
-    ASSERT(mailHdr.length <= MaxMailSize);
-    ASSERT(0 <= mailHdr.to && mailHdr.to < numBoxes);
-    
-    // fill in pktHdr, for the Network layer
+    // fill in pktHdr, for the Network layer, and who we are
     pktHdr.from = netAddr;
+    mailHdr.epoch = epoch;
     pktHdr.length = mailHdr.length + sizeof(MailHeader);
 
-    // concatenate MailHeader and data
-    bcopy((char *) &mailHdr, buffer, sizeof(MailHeader));
-    bcopy(data, buffer + sizeof(MailHeader), mailHdr.length);
+    Mail *mail = new Mail(pktHdr, mailHdr, data);
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    outgoing->Append((void *) mail);
+    if (!networkBusy)
+	StartNextPacket();
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// PostOffice::StartNextPacket
+// 	Concatenate the MailHeader of the next queued packet to the 
+//	front of its data, and pass the result to the Network for delivery
+//	to the destination machine.
+//
+//	Note that the MailHeader + data looks just like normal payload
+//	data to the Network.
+//
+//	Called with interrupts off, from SendPacket or PacketSent.
+//----------------------------------------------------------------------
 
-    sendLock->Acquire();   		// only one message can be sent
-					// to the network at any one time
-    bool success = network->Send(pktHdr, buffer);
-    messageSent->P();			// wait for interrupt to tell us
-					// ok to send the next message
-    sendLock->Release();
+void
+PostOffice::StartNextPacket()
+{
+    char buffer[MaxPacketSize];		// space to hold concatenated
+					// mailHdr + data
+    Mail *mail = (Mail *) outgoing->Remove();
+
+    if (mail == NULL) {
+	networkBusy = FALSE;
+	return;
+    }
 
-    delete [] buffer;			// we've sent the message, so
-					// we can delete our buffer
-    return success;
+    bcopy((char *) &mail->mailHdr, buffer, sizeof(MailHeader));
+    bcopy(mail->data, buffer + sizeof(MailHeader), mail->mailHdr.length);
+    networkBusy = TRUE;
+    network->Send(mail->pktHdr, buffer);
+    delete mail;
 }
 
 //----------------------------------------------------------------------
-// PostOffice::Send
+// PostOffice::Receive
 // 	Retrieve a message from a specific box if one is available, 
 //	otherwise wait for a message to arrive in the box.
 //
@@ -307,18 +702,35 @@ PostOffice::Send(PacketHeader pktHdr, MailHeader mailHdr, char* data)
 //	"pktHdr" -- address to put: source, destination machine ID's
 //	"mailHdr" -- address to put: source, destination mailbox ID's
 //	"data" -- address to put: payload message data
+//	"size" -- the most bytes of it to put there
 //----------------------------------------------------------------------
 
 void
 PostOffice::Receive(int box, PacketHeader *pktHdr, 
-				MailHeader *mailHdr, char* data)
+				MailHeader *mailHdr, char* data, int size)
 {
     ASSERT((box >= 0) && (box < numBoxes));
 
-    boxes[box].Get(pktHdr, mailHdr, data);
+    boxes[box].Get(pktHdr, mailHdr, data, size);
     ASSERT(mailHdr->length <= MaxMailSize);
 }
 
+//----------------------------------------------------------------------
+// PostOffice::TryReceive
+// 	Retrieve a message from a specific box if one is available, 
+//	like PostOffice::Receive.  Returns FALSE at once if the box is
+//	empty.
+//----------------------------------------------------------------------
+
+bool
+PostOffice::TryReceive(int box, PacketHeader *pktHdr, 
+				MailHeader *mailHdr, char* data, int size)
+{
+    ASSERT((box >= 0) && (box < numBoxes));
+
+    return boxes[box].TryGet(pktHdr, mailHdr, data, size);
+}
+
 //----------------------------------------------------------------------
 // PostOffice::IncomingPacket
 // 	Interrupt handler, called when a packet arrives from the network.
@@ -332,10 +744,25 @@ PostOffice::IncomingPacket()
     messageAvailable->V(); 
 }
 
+//----------------------------------------------------------------------
+// PostOffice::RetransmitTimeout
+// 	Interrupt handler, called RetransmitTime after the retransmit 
+//	timer was started.
+//
+//	Wake up the retransmitter to look for lost messages.
+//----------------------------------------------------------------------
+
+void
+PostOffice::RetransmitTimeout()
+{ 
+    timerPending = FALSE;
+    retransmitWanted->V(); 
+}
+
 //----------------------------------------------------------------------
 // PostOffice::PacketSent
 // 	Interrupt handler, called when the next packet can be put onto the 
-//	network.
+//	network.  Send the next one waiting, if there is one.
 //
 //	The name of this routine is a misnomer; if "reliability < 1",
 //	the packet could have been dropped by the network, so it won't get
@@ -345,6 +772,6 @@ PostOffice::IncomingPacket()
 void 
 PostOffice::PacketSent()
 { 
-    messageSent->V();
+    StartNextPacket();
 }
 
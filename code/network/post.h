@@ -1,8 +1,10 @@
 // post.h 
-//	Data structures for providing the abstraction of unreliable,
+//	Data structures for providing the abstraction of reliable,
 //	ordered, fixed-size message delivery to mailboxes on other 
-//	(directly connected) machines.  Messages can be dropped by
-//	the network, but they are never corrupted.
+//	(directly connected) machines.  Packets can be dropped by
+//	the network, but they are never corrupted; the post office
+//	numbers the messages between each pair of mailboxes, and
+//	resends them until they are acknowledged.
 //
 // 	The US Post Office delivers mail to the addressed mailbox. 
 // 	By analogy, our post office delivers packets to a specific buffer 
@@ -43,14 +45,37 @@ class MailHeader {
   public:
     MailBoxAddress to;		// Destination mail box
     MailBoxAddress from;	// Mail box to reply to
-    unsigned length;		// Bytes of message data (excluding the 
-				// mail header)
+    unsigned short length;	// Bytes of message data (excluding the 
+				// mail header); on the wire, bytes in
+				// this fragment of the message
+    unsigned short more;	// On the wire, TRUE if more fragments of
+				// the message follow this one
+    int seq;			// Number of this message among those from
+				// "from" to "to", or NoSeq for a bare ack
+    int ack;			// Next message expected from "to" to 
+				// "from"; acknowledges all before it
+    int epoch;			// Incarnation of the sending post office,
+				// filled in by it
 };
 
-// Maximum "payload" -- real data -- that can included in a single message
-// Excluding the MailHeader and the PacketHeader
+#define NoSeq		-1	// seq of a packet that is only an ack
 
-#define MaxMailSize 	(MaxPacketSize - sizeof(MailHeader))
+#define WindowSize	8	// messages that can be waiting for an ack
+				// from any one mailbox
+#define RetransmitTime	(int64_t)2000LL	// resend messages that haven't
+				// been acknowledged this long after
+				// they were last sent
+#define ConnectionBuckets 64	// size of the connection hash table
+
+// Maximum "payload" -- real data -- that can included in a single packet
+// Excluding the MailHeader and the PacketHeader.  Longer messages are
+// split into fragments of this size, and put back together at the
+// other end.
+
+#define MaxFragmentSize	(MaxPacketSize - sizeof(MailHeader))
+
+// Maximum "payload" of a message
+#define MaxMailSize 	4096
 
 
 // The following class defines the format of an incoming/outgoing 
@@ -65,9 +90,52 @@ class Mail {
 				// Initialize a mail message by
 				// concatenating the headers to the data
 
+     ~Mail();			// De-allocate the message data
+
      PacketHeader pktHdr;	// Header appended by Network
      MailHeader mailHdr;	// Header appended by PostOffice
-     char data[MaxMailSize];	// Payload -- message data
+     char *data;		// Payload -- message data, mailHdr.length 
+				// bytes of it
+};
+
+// The following class holds the state of the conversation between a 
+// mailbox on this machine and one on another machine: the messages 
+// sent that haven't been acknowledged yet, and the next message 
+// expected.
+
+class Connection {
+  public:
+    Connection(MailBoxAddress localBox, NetworkAddress remoteMachine,
+		MailBoxAddress remoteBox);
+    ~Connection();
+
+    void Reset();		// Start again from seq 0 in both
+				// directions, forgetting anything 
+				// unacknowledged or half received
+
+    MailBoxAddress localBox;	// Mailbox on this machine
+    NetworkAddress remoteMachine; // Machine and mailbox at the other end
+    MailBoxAddress remoteBox;
+
+    int nextSeq;		// seq of the next message sent
+    int firstUnacked;		// seq of the oldest unacknowledged one
+    Mail *window[WindowSize];	// unacknowledged messages, by seq
+				// modulo WindowSize
+    int64_t lastSent;		// when the window was last (re)sent
+    Condition *windowOpen;	// signalled when acks make room in 
+				// the window
+
+    int expectedSeq;		// seq of the next message to deliver
+    char *reassembly;		// fragments of the message being received
+    int reassembled;		// bytes of it received so far
+    Lock *sendLock;		// one message sent at a time, so their
+				// fragments aren't interleaved
+    bool discarding;		// throwing away the rest of a message
+				// too long to reassemble
+    int remoteEpoch;		// incarnation of the other end, or 0 
+				// until we hear from it
+
+    Connection *next;		// next connection in the hash bucket
 };
 
 // The following class defines a single mailbox, or temporary storage
@@ -82,12 +150,20 @@ class MailBox {
 
     void Put(PacketHeader pktHdr, MailHeader mailHdr, char *data);
    				// Atomically put a message into the mailbox
-    void Get(PacketHeader *pktHdr, MailHeader *mailHdr, char *data); 
+    void Get(PacketHeader *pktHdr, MailHeader *mailHdr, char *data,
+		int size); 
    				// Atomically get a message out of the 
 				// mailbox (and wait if there is no message 
-				// to get!)
+				// to get!); at most "size" bytes of it
+				// are copied to "data"
+    bool TryGet(PacketHeader *pktHdr, MailHeader *mailHdr, char *data,
+		int size);
+				// The same, but return FALSE instead of
+				// waiting if there is no message
   private:
     SynchList *messages;	// A mailbox is just a list of arrived messages
+    void CopyOut(Mail *mail, PacketHeader *pktHdr, MailHeader *mailHdr,
+		char *data, int size);	// Return a message, and discard it
 };
 
 // The following class defines a "Post Office", or a collection of 
@@ -110,16 +186,32 @@ class PostOffice {
     bool Send(PacketHeader pktHdr, MailHeader mailHdr, char *data);
     				// Send a message to a mailbox on a remote 
 				// machine.  The fromBox in the MailHeader is 
-				// the return box for ack's.
+				// the return box for ack's.  Returns once
+				// the message is queued, unless WindowSize
+				// packets to that mailbox are still 
+				// unacknowledged.  The message can be up to
+				// MaxMailSize bytes; it is sent in 
+				// fragments if it won't fit in a packet.
     
     void Receive(int box, PacketHeader *pktHdr, 
-		MailHeader *mailHdr, char *data);
+		MailHeader *mailHdr, char *data, int size = MaxMailSize);
     				// Retrieve a message from "box".  Wait if
-				// there is no message in the box.
+				// there is no message in the box.  Only
+				// the first "size" bytes are copied to
+				// "data"; mailHdr->length is the whole 
+				// length, so the caller can tell if it 
+				// was cut short.
+    bool TryReceive(int box, PacketHeader *pktHdr, 
+		MailHeader *mailHdr, char *data, int size = MaxMailSize);
+				// Retrieve a message from "box" if there
+				// is one; return FALSE if there isn't.
 
     void PostalDelivery();	// Wait for incoming messages, 
 				// and then put them in the correct mailbox
 
+    void Retransmit();		// Wait for the retransmit timer, and then
+				// resend the messages it timed out
+
     void PacketSent();		// Interrupt handler, called when outgoing 
 				// packet has been put on network; next 
 				// packet can now be sent
@@ -127,16 +219,36 @@ class PostOffice {
    				// packet has arrived and can be pulled
 				// off of network (i.e., time to call 
 				// PostalDelivery)
+    void RetransmitTimeout();	// Interrupt handler, called when it is 
+				// time to look for messages to resend
     NetworkAddress getNetAddr() { return netAddr; }
 
   private:
     Network *network;		// Physical network connection
     NetworkAddress netAddr;	// Network address of this machine
+    int epoch;			// Incarnation of this post office
     MailBox *boxes;		// Table of mail boxes to hold incoming mail
     int numBoxes;		// Number of mail boxes
     Semaphore *messageAvailable;// V'ed when message has arrived from network
-    Semaphore *messageSent;	// V'ed when next message can be sent to network
-    Lock *sendLock;		// Only one outgoing message at a time
+    List *outgoing;		// Packets waiting for the network, which
+				// takes one at a time
+    bool networkBusy;		// A packet is on its way out
+
+    Connection *connections[ConnectionBuckets]; // hash table of the
+				// conversations with other mailboxes
+    Lock *connectionLock;	// Protects the connections
+    Semaphore *retransmitWanted;// V'ed when the retransmit timer expires
+    bool timerPending;		// The retransmit timer is running
+
+    Connection *FindConnection(MailBoxAddress localBox, 
+		NetworkAddress remoteMachine, MailBoxAddress remoteBox);
+				// Look up a conversation, starting it 
+				// if it is new
+    void SendPacket(PacketHeader pktHdr, MailHeader mailHdr, char *data);
+				// Queue one packet for the network
+    void StartNextPacket();	// Hand the network the next queued packet
+    void StartRetransmitTimer(); // Schedule the retransmit timer if it 
+				// isn't already
 };
 
 #endif
@@ -0,0 +1,30 @@
+/* exitLocks.c
+ *	Test that a process's locks and conditions are destroyed when
+ *	its last thread exits, even though it never destroyed them and
+ *	exits holding them.  Run with -d q: DESTROYING LOCK should be
+ *	printed twice and DESTROYING CONDITION once, after both threads
+ *	have exited.
+ */
+
+#include "syscall.h"
+
+int lock0, lock1, cv0;
+
+void holder() {
+  Acquire(lock1);
+  Print("Forked thread exiting with lock1\n",0,0,0);
+  Exit(0);
+}
+
+int main() {
+  lock0 = CreateLock("lk0");
+  lock1 = CreateLock("lk1");
+  cv0 = CreateCondition();
+
+  Acquire(lock0);
+  Fork(holder, 0);
+  Yield();
+
+  Print("Main thread exiting with lock0\n",0,0,0);
+  Exit(0);
+}
@@ -243,6 +243,38 @@ CreateMV:
 	j	$31
 	.end CreateMV
 
+	.globl Mmap
+	.ent	Mmap
+Mmap:
+	addiu $2,$0,SC_Mmap
+	syscall
+	j	$31
+	.end Mmap
+
+	.globl Munmap
+	.ent	Munmap
+Munmap:
+	addiu $2,$0,SC_Munmap
+	syscall
+	j	$31
+	.end Munmap
+
+	.globl GetMVs
+	.ent	GetMVs
+GetMVs:
+	addiu $2,$0,SC_GetMVs
+	syscall
+	j	$31
+	.end GetMVs
+
+	.globl SetMVs
+	.ent	SetMVs
+SetMVs:
+	addiu $2,$0,SC_SetMVs
+	syscall
+	j	$31
+	.end SetMVs
+
 /* dummy function to keep gcc happy */
         .globl  __main
         .ent    __main
@@ -5,7 +5,8 @@
 // 	A "ListElement" is allocated for each item to be put on the
 //	list; it is de-allocated when the item is removed. This means
 //      we don't need to keep a "next" pointer in every object we
-//      want to put on a list.
+//      want to put on a list.  ListElements come from a pool (see
+//	ListElement::operator new), so this is cheap.
 // 
 //     	NOTE: Mutual exclusion must be provided by the caller.
 //  	If you want a synchronized list, you must use the routines 
@@ -34,6 +35,54 @@ ListElement::ListElement(void *itemPtr, int64_t sortKey)
      next = NULL;	// assume we'll put it at the end of the list 
 }
 
+//----------------------------------------------------------------------
+// ListElement::operator new
+// 	Take a list element off the pool's free list, refilling the
+//	pool with a chunk of ListElementChunk elements if it is empty.
+//	Chunks are never given back to the heap.
+//
+//	No locking is needed: a thread can only lose the CPU inside
+//	the kernel when interrupts are re-enabled, and we never do that
+//	here, so the free list is updated atomically.
+//----------------------------------------------------------------------
+
+ListElement *ListElement::freeList = NULL;
+
+void *
+ListElement::operator new(size_t size)
+{
+    ListElement *element;
+
+    ASSERT(size == sizeof(ListElement));
+    if (freeList == NULL) {
+	ListElement *chunk = (ListElement *) 
+			::operator new(ListElementChunk * sizeof(ListElement));
+	for (int i = 0; i < ListElementChunk; i++) {
+	    chunk[i].next = freeList;
+	    freeList = &chunk[i];
+	}
+    }
+    element = freeList;
+    freeList = element->next;
+    return (void *) element;
+}
+
+//----------------------------------------------------------------------
+// ListElement::operator delete
+// 	Return a list element to the pool.
+//----------------------------------------------------------------------
+
+void
+ListElement::operator delete(void *ptr)
+{
+    ListElement *element = (ListElement *) ptr;
+
+    if (element == NULL)
+	return;
+    element->next = freeList;
+    freeList = element;
+}
+
 //----------------------------------------------------------------------
 // List::List
 //	Initialize a list, empty to start with.
@@ -160,6 +209,51 @@ List::IsEmpty()
 	return FALSE; 
 }
 
+//----------------------------------------------------------------------
+// List::Front
+//      Return the first item on the list, leaving it on the list.
+//	Returns NULL if the list is empty.
+//----------------------------------------------------------------------
+
+void *
+List::Front()
+{
+    if (IsEmpty())
+	return NULL;
+    return first->item;
+}
+
+//----------------------------------------------------------------------
+// List::RemoveItem
+//      Remove "item" from the list, wherever it happens to be.  Used
+//	when something on a sorted list changes its priority and has
+//	to be put back in a different place.
+//
+// Returns:
+//	TRUE if the item was found on the list.
+//----------------------------------------------------------------------
+
+bool
+List::RemoveItem(void *item)
+{
+    ListElement *prev = NULL;
+    ListElement *ptr;
+
+    for (ptr = first; ptr != NULL; prev = ptr, ptr = ptr->next) {
+	if (ptr->item != item)
+	    continue;
+	if (prev == NULL)
+	    first = ptr->next;
+	else
+	    prev->next = ptr->next;
+	if (last == ptr)
+	    last = prev;
+	delete ptr;
+	return TRUE;
+    }
+    return FALSE;
+}
+
 //----------------------------------------------------------------------
 // List::SortedInsert
 //      Insert an "item" into a list, so that the list elements are
@@ -24,14 +24,30 @@
 // Internal data structures kept public so that List operations can
 // access them directly.
 
+//
+// List elements are allocated from a pool rather than the heap: freed
+// elements go on a free list and are handed out again, and the pool
+// only grows (by ListElementChunk elements at a time) when it is empty.
+// Every ready queue and wait queue operation allocates and frees an
+// element, so in steady state this keeps them from calling the
+// real new and delete.
+
+#define ListElementChunk	256
+
 class ListElement {
    public:
      ListElement(void *itemPtr, int64_t sortKey);	// initialize a list element
 
+     void *operator new(size_t size);	// take an element from the pool
+     void operator delete(void *ptr);	// put an element back in the pool
+
      ListElement *next;		// next element on list, 
 				// NULL if this is the last
      int64_t key;		    	// priority, for a sorted list
      void *item; 	    	// pointer to item on the list
+
+   private:
+     static ListElement *freeList;	// elements not on any list
 };
 
 // The following class defines a "list" -- a singly linked list of
@@ -52,6 +68,10 @@ class List {
     void Mapcar(VoidFunctionPtr func);	// Apply "func" to every element 
 					// on the list
     bool IsEmpty();		// is the list empty? 
+    void *Front();		// Return the first item, without
+				// taking it off the list
+    bool RemoveItem(void *item);	// Take "item" off the list,
+					// wherever it is
     
 
     // Routines to put/get items on/off list in order (sorted by key)
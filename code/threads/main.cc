@@ -8,16 +8,18 @@
 //
 // 	Most of this file is not needed until later assignments.
 //
-// Usage: nachos -d <debugflags> -rs <random seed #>
+// Usage: nachos -d <debugflags> -rs <random seed #> -mlfq -sp <# stacks>
 //		-s -x <nachos file> -c <consoleIn> <consoleOut>
 //		-f -cp <unix file> <nachos file>
 //		-p <nachos file> -r <nachos file> -l -D -t
 //              -n <network reliability> -m <machine id>
-//              -o <other machine id>
+//              -o <other machine id> -ns <# servers> -shm
 //              -z
 //
 //    -d causes certain debugging messages to be printed (cf. utility.h)
 //    -rs causes Yield to occur at random (but repeatable) spots
+//    -mlfq uses the multilevel feedback queue scheduler instead of FIFO
+//    -sp sets how many freed thread stacks are kept for reuse (0 disables)
 //    -z prints the copyright message
 //
 //  USER_PROGRAM
@@ -35,10 +37,17 @@
 //    -t tests the performance of the Nachos file system
 //
 //  NETWORK
-//    -n sets the network reliability
+//    -n sets the network reliability (the post office resends lost
+//	packets, so messages still arrive, only later)
 //    -m sets this machine's host id (needed for the network)
 //    -o runs a simple test of the Nachos network software
 //    -server starts the Project 3 Part 3 Server
+//    -ns spreads the Project 3 locks, conditions and MVs over this
+//	many servers, on machines 0 and up (every machine must be
+//	given the same number)
+//    -shm sends packets through shared memory rings instead of UNIX
+//	sockets, for machines on the same host with ids below 64 (every
+//	machine must be given it)
 //
 //  NOTE -- flags are ignored until the relevant assignment.
 //  Some of the flags are interpreted here; some in system.cc.
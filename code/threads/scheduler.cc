@@ -11,8 +11,11 @@
 //	end up calling FindNextToRun(), and that would put us in an 
 //	infinite loop.
 //
-// 	Very simple implementation -- no priorities, straight FIFO.
-//	Might need to be improved in later assignments.
+// 	Two policies are supported: the original straight FIFO, and a
+//	multilevel feedback queue (selected with -mlfq) in which each
+//	priority level has its own ready list.  Under MLFQ a thread that
+//	uses up its quantum is demoted one level, and every BoostInterval
+//	timer interrupts all threads are moved back to their base priority.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -24,22 +27,35 @@
 
 //----------------------------------------------------------------------
 // Scheduler::Scheduler
-// 	Initialize the list of ready but not running threads to empty.
+// 	Initialize the lists of ready but not running threads to empty.
+//
+//	"how" is the scheduling policy to use.
 //----------------------------------------------------------------------
 
-Scheduler::Scheduler()
+Scheduler::Scheduler(SchedulerPolicy how)
 { 
-    readyList = new List; 
+    policy = how;
+    ticksSinceBoost = 0;
+    finished = new List;
+    numFinished = 0;
+#ifdef USER_PROGRAM
+    lastSpace = NULL;
+#endif
+    for (int i = 0; i < NumPriorityLevels; i++)
+	readyList[i] = new List; 
 } 
 
 //----------------------------------------------------------------------
 // Scheduler::~Scheduler
-// 	De-allocate the list of ready threads.
+// 	De-allocate the lists of ready threads.
 //----------------------------------------------------------------------
 
 Scheduler::~Scheduler()
 { 
-    delete readyList; 
+    for (int i = 0; i < NumPriorityLevels; i++)
+	delete readyList[i]; 
+    Reap();
+    delete finished;
 } 
 
 //----------------------------------------------------------------------
@@ -56,12 +72,16 @@ Scheduler::ReadyToRun (Thread *thread)
     DEBUG('t', "Putting thread %s on ready list.\n", thread->getName());
 
     thread->setStatus(READY);
-    readyList->Append((void *)thread);
+    if (policy == MLFQ_SCHEDULING)
+	readyList[thread->getPriority()]->Append((void *)thread);
+    else
+	readyList[MinPriority]->Append((void *)thread);
 }
 
 //----------------------------------------------------------------------
 // Scheduler::FindNextToRun
-// 	Return the next thread to be scheduled onto the CPU.
+// 	Return the next thread to be scheduled onto the CPU -- the
+//	first thread on the highest priority non-empty ready list.
 //	If there are no ready threads, return NULL.
 // Side effect:
 //	Thread is removed from the ready list.
@@ -70,7 +90,126 @@ Scheduler::ReadyToRun (Thread *thread)
 Thread *
 Scheduler::FindNextToRun ()
 {
-    return (Thread *)readyList->Remove();
+    for (int level = MaxPriority; level >= MinPriority; level--)
+	if (!readyList[level]->IsEmpty())
+	    return (Thread *)readyList[level]->Remove();
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::NoneReady
+// 	Return TRUE if there are no threads waiting to run.  Used by
+//	Thread::Yield to skip the scheduler when there is no one to
+//	yield to.
+//----------------------------------------------------------------------
+
+bool
+Scheduler::NoneReady ()
+{
+    for (int level = MaxPriority; level >= MinPriority; level--)
+	if (!readyList[level]->IsEmpty())
+	    return FALSE;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Reprioritize
+// 	Called when the priority of "thread" has changed (for instance,
+//	because another thread donated its priority to it).  If the
+//	thread is sitting on a ready list, move it to the list for its
+//	new priority.  Assumes interrupts are disabled.
+//----------------------------------------------------------------------
+
+void
+Scheduler::Reprioritize (Thread *thread)
+{
+    if (policy != MLFQ_SCHEDULING || thread->getStatus() != READY)
+	return;
+    for (int level = MaxPriority; level >= MinPriority; level--)
+	if (readyList[level]->RemoveItem((void *)thread))
+	    break;
+    readyList[thread->getPriority()]->Append((void *)thread);
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Quantum
+// 	Return the number of timer interrupts a thread may run for at
+//	priority "level" before it is demoted.  Lower levels get longer
+//	quanta, since the threads there are the CPU bound ones.
+//----------------------------------------------------------------------
+
+int
+Scheduler::Quantum (int level)
+{
+    return 1 << (MaxPriority - level);
+}
+
+//----------------------------------------------------------------------
+// Scheduler::TimerTick
+// 	Called from the timer interrupt handler, with interrupts
+//	disabled.  Under FIFO scheduling every timer interrupt causes
+//	a context switch, as before.  Under MLFQ the running thread is
+//	charged for the tick and demoted once it has used up its quantum;
+//	it is only preempted when its quantum runs out or a higher
+//	priority thread is waiting.
+//----------------------------------------------------------------------
+
+bool
+Scheduler::TimerTick ()
+{
+    Thread *thread = currentThread;
+    bool preempt = FALSE;
+    int level;
+
+    if (policy == FIFO_SCHEDULING)
+	return TRUE;
+
+    if (++ticksSinceBoost >= BoostInterval) {
+	ticksSinceBoost = 0;
+	Boost();
+    }
+
+    if (++thread->quantumUsed >= Quantum(thread->getCurrentPriority())) {
+	thread->quantumUsed = 0;
+	if (thread->getCurrentPriority() > MinPriority) {
+	    thread->setCurrentPriority(thread->getCurrentPriority() - 1);
+	    DEBUG('t', "Demoting thread \"%s\" to priority %d\n",
+		  thread->getName(), thread->getCurrentPriority());
+	}
+	preempt = TRUE;
+    }
+    for (level = MaxPriority; level > thread->getPriority(); level--)
+	if (!readyList[level]->IsEmpty())
+	    preempt = TRUE;
+    return preempt;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Boost
+// 	Move every ready thread, and the running one, back to its base
+//	priority and give it a fresh quantum.  Threads keep their
+//	relative order within each level.
+//----------------------------------------------------------------------
+
+void
+Scheduler::Boost ()
+{
+    List boosted;
+    Thread *thread;
+    int level;
+
+    DEBUG('t', "Boosting all threads to their base priority\n");
+    for (level = MaxPriority; level >= MinPriority; level--)
+	while ((thread = (Thread *)readyList[level]->Remove()) != NULL)
+	    boosted.Append((void *)thread);
+
+    while ((thread = (Thread *)boosted.Remove()) != NULL) {
+	thread->setCurrentPriority(thread->getBasePriority());
+	thread->quantumUsed = 0;
+	ReadyToRun(thread);
+    }
+    currentThread->setCurrentPriority(currentThread->getBasePriority());
+    currentThread->quantumUsed = 0;
 }
 
 //----------------------------------------------------------------------
@@ -81,6 +220,13 @@ Scheduler::FindNextToRun ()
 //
 //      Note: we assume the state of the previously running thread has
 //	already been changed from running to blocked or ready (depending).
+//
+//	The address space state is only saved and restored when we are
+//	actually switching to a different address space: kernel threads
+//	(space == NULL) leave the machine's translations alone, and
+//	threads forked in the same process share them, so neither needs
+//	the page table reloaded or the TLB flushed.  User registers are
+//	always saved and restored, since every thread has its own.
 // Side effect:
 //	The global variable currentThread becomes nextThread.
 //
@@ -95,7 +241,8 @@ Scheduler::Run (Thread *nextThread)
 #ifdef USER_PROGRAM			// ignore until running user programs 
     if (currentThread->space != NULL) {	// if this thread is a user program,
         currentThread->SaveUserState(); // save the user's CPU registers
-	currentThread->space->SaveState();
+	if (nextThread->space != currentThread->space)
+	    currentThread->space->SaveState();
     }
 #endif
     
@@ -121,19 +268,43 @@ Scheduler::Run (Thread *nextThread)
     // we need to delete its carcass.  Note we cannot delete the thread
     // before now (for example, in Thread::Finish()), because up to this
     // point, we were still running on the old thread's stack!
+    // Finished threads are collected and deleted ReapBatchSize at a time.
     if (threadToBeDestroyed != NULL) {
-        delete threadToBeDestroyed;
+	finished->Append((void *)threadToBeDestroyed);
 	threadToBeDestroyed = NULL;
+	if (++numFinished >= ReapBatchSize)
+	    Reap();
     }
     
 #ifdef USER_PROGRAM
     if (currentThread->space != NULL) {		// if there is an address space
         currentThread->RestoreUserState();     // to restore, do it.
-	currentThread->space->RestoreState();
+	if (currentThread->space != lastSpace) { // unless it is already loaded
+	    currentThread->space->RestoreState();
+	    lastSpace = currentThread->space;
+	}
     }
 #endif
 }
 
+//----------------------------------------------------------------------
+// Scheduler::Reap
+// 	Delete all the threads that have finished since the last reap.
+//	Their control blocks and stacks go back to the thread slabs and
+//	the stack pool.  None of them can be the running thread, since
+//	they were only queued after we switched away from them.
+//----------------------------------------------------------------------
+
+void
+Scheduler::Reap ()
+{
+    Thread *thread;
+
+    while ((thread = (Thread *)finished->Remove()) != NULL)
+	delete thread;
+    numFinished = 0;
+}
+
 //----------------------------------------------------------------------
 // Scheduler::Print
 // 	Print the scheduler state -- in other words, the contents of
@@ -143,5 +314,12 @@ void
 Scheduler::Print()
 {
     printf("Ready list contents:\n");
-    readyList->Mapcar((VoidFunctionPtr) ThreadPrint);
+    for (int level = MaxPriority; level >= MinPriority; level--) {
+	if (readyList[level]->IsEmpty())
+	    continue;
+	if (policy == MLFQ_SCHEDULING)
+	    printf("  priority %d: ", level);
+	readyList[level]->Mapcar((VoidFunctionPtr) ThreadPrint);
+	printf("\n");
+    }
 }
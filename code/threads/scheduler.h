@@ -13,13 +13,23 @@
 #include "list.h"
 #include "thread.h"
 
+// Scheduling policies.  FIFO is the original Nachos behavior; MLFQ
+// keeps one ready queue per priority level, demotes threads that use
+// up their quantum, and periodically boosts everyone back to their
+// base priority so that low priority threads can't starve.
+enum SchedulerPolicy { FIFO_SCHEDULING, MLFQ_SCHEDULING };
+
+// Number of timer interrupts between MLFQ priority boosts.
+#define BoostInterval	50
+
 // The following class defines the scheduler/dispatcher abstraction -- 
 // the data structures and operations needed to keep track of which 
 // thread is running, and which threads are ready but not running.
 
 class Scheduler {
   public:
-    Scheduler();			// Initialize list of ready threads 
+    Scheduler(SchedulerPolicy how = FIFO_SCHEDULING);
+					// Initialize list of ready threads 
     ~Scheduler();			// De-allocate ready list
 
     void ReadyToRun(Thread* thread);	// Thread can be dispatched.
@@ -27,10 +37,35 @@ class Scheduler {
 					// list, if any, and return thread.
     void Run(Thread* nextThread);	// Cause nextThread to start running
     void Print();			// Print contents of ready list
+
+    bool TimerTick();			// Charge the current thread for a
+					// timer interrupt; TRUE if it
+					// should be preempted
+    SchedulerPolicy getPolicy() { return policy; }
+    void Reprioritize(Thread* thread);	// Thread's priority has changed
+    bool NoneReady();			// TRUE if all ready lists are empty
+    void Reap();			// Delete the finished threads
+#ifdef USER_PROGRAM
+    void ForgetSpace(AddrSpace *space)	// space is being deleted
+	{ if (lastSpace == space) lastSpace = NULL; }
+#endif
     
   private:
-    List *readyList;  		// queue of threads that are ready to run,
-				// but not running
+    int Quantum(int level);		// timer interrupts allowed at level
+    void Boost();			// move every thread back to its
+					// base priority
+
+    SchedulerPolicy policy;
+    List *readyList[NumPriorityLevels];	// queues of threads that are ready
+					// to run, but not running, one
+					// per priority level
+    int ticksSinceBoost;
+    List *finished;			// threads waiting to be deleted
+    int numFinished;
+#ifdef USER_PROGRAM
+    AddrSpace *lastSpace;		// address space whose translations
+					// are loaded in the machine
+#endif
 };
 
 #endif // SCHEDULER_H
@@ -104,6 +104,7 @@ Lock::Lock(char* debugName) {
 
   name = debugName;
   thread = NULL;
+  nextHeld = NULL;
 
   FREE = true;
   BUSY = false;
@@ -114,6 +115,8 @@ Lock::Lock(char* debugName) {
 }
 Lock::~Lock() { 
 
+  if(thread != NULL)  // don't leave a dangling pointer in the owner's held locks
+    RemoveHolder(thread);
   delete wait_queue; // De allocate memeory
 
 }
@@ -163,10 +166,20 @@ void Lock::Acquire() {
     BUSY   = true; // The lock state becomes busy
     thread = currentThread; // The owner of the lock is the currentThread
     FREE   = false; // The lock state is not free (busy)  
+    AddHolder(currentThread);
 
-  } else { // If the lock is not free, then we must attach the currentThread to the wait queue 
+  } else { // If the lock is not free, then we must attach the currentThread to the wait queue.
+           // Under -mlfq it goes in priority order, and lends its priority to the owner so 
+           // that a low priority owner can't keep us waiting behind medium priority threads;
+           // otherwise the lock is handed off in FIFO order, as it always was
     DEBUG('e',"Lock is not available\n");
-    wait_queue->Append(currentThread);
+    currentThread->waitingOn = this;
+    if(scheduler->getPolicy() == MLFQ_SCHEDULING) {
+      wait_queue->SortedInsert(currentThread, MaxPriority - currentThread->getPriority());
+      DonatePriority(currentThread);
+    } else {
+      wait_queue->Append(currentThread);
+    }
     currentThread->Sleep();
   }
 
@@ -207,21 +220,101 @@ void Lock::Release() {
                                  // are threads waiting to use this lock
                                  // We have to remove a thread from the wait queue
                                  // wake it up, and set it as the new owner of the lock
-    Thread *newthread = (Thread*)wait_queue->Remove();
-    scheduler->ReadyToRun(newthread); // Waking up the thread (adding it to CPU Scheduler Ready Queue) 
+    RemoveHolder(thread);
+    Thread *newthread = (Thread*)wait_queue->Remove(); // highest priority waiter
+    newthread->waitingOn = NULL;
     thread = newthread; // The thread removed from the wait queue is now the lock owner
+    AddHolder(newthread); // anyone still waiting now donates to the new owner
+    UpdateDonation(newthread);
+    scheduler->ReadyToRun(newthread); // Waking up the thread (adding it to CPU Scheduler Ready Queue) 
   } else {                       // If the wait queue is empty
                                  // then there is no one to acquire this lock 
                                  // and therefore the lock will have no owner
+    RemoveHolder(thread);
     FREE   = true; 
     BUSY   = false;
     thread = NULL;
   }
 
+  // We no longer hold this lock, so give back whatever priority its
+  // waiters lent us
+  UpdateDonation(currentThread);
+
   // Restore interrupts to allow context switching
   interrupt->SetLevel(old);
 }
 
+void Lock::DonatePriority(Thread *donor) {
+  // Walk down the chain: the owner of this lock, the owner of the lock
+  // that owner is waiting on, and so on, raising each one to the donor's
+  // priority. We can stop as soon as we reach an owner that already runs
+  // at least that high, since everyone past it was raised earlier.
+  int priority = donor->getPriority();
+  Lock *lock = this;
+
+  while(lock != NULL && lock->thread != NULL && lock->thread->getPriority() < priority) {
+    Thread *owner = lock->thread;
+    DEBUG('e',"%s donates priority %d to %s\n", donor->getName(), priority, owner->getName());
+    owner->donatedPriority = priority;
+    if(owner->waitingOn != NULL) {  // the owner is itself waiting, so its place
+      owner->waitingOn->Requeue(owner); // in that lock's wait queue moves up
+    } else {
+      scheduler->Reprioritize(owner);
+    }
+    lock = owner->waitingOn;
+  }
+}
+
+void Lock::Requeue(Thread *waiter) {
+  // Re-sort a waiter whose priority just changed
+  if(wait_queue->RemoveItem(waiter))
+    wait_queue->SortedInsert(waiter, MaxPriority - waiter->getPriority());
+}
+
+void Lock::AddHolder(Thread *owner) {
+  nextHeld = owner->locksHeld;
+  owner->locksHeld = this;
+}
+
+void Lock::RemoveHolder(Thread *owner) {
+  Lock **ptr;
+  for(ptr = &owner->locksHeld; *ptr != NULL; ptr = &(*ptr)->nextHeld) {
+    if(*ptr == this) {
+      *ptr = nextHeld;
+      break;
+    }
+  }
+  nextHeld = NULL;
+}
+
+void Lock::UpdateDonation(Thread *t) {
+  // A thread's donated priority is that of the highest priority thread
+  // waiting on any lock it still holds. Each wait queue is sorted, so
+  // only the front of each one needs to be looked at. Without -mlfq
+  // nothing is donated and the queues are FIFO.
+  int donated = MinPriority - 1;
+  Lock *lock;
+
+  if(scheduler->getPolicy() != MLFQ_SCHEDULING)
+    return;
+
+  for(lock = t->locksHeld; lock != NULL; lock = lock->nextHeld) {
+    Thread *waiter = (Thread*)lock->wait_queue->Front();
+    if(waiter != NULL && waiter->getPriority() > donated)
+      donated = waiter->getPriority();
+  }
+  if(donated != t->donatedPriority) {
+    t->donatedPriority = donated;
+    if(t->waitingOn != NULL) {  // pass the change on down the chain
+      t->waitingOn->Requeue(t);
+      if(t->waitingOn->thread != NULL)
+        UpdateDonation(t->waitingOn->thread);
+    } else {
+      scheduler->Reprioritize(t);
+    }
+  }
+}
+
 Condition::Condition(char* debugName) { 
   
   // Initialization of private variables in Condition Class
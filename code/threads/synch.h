@@ -79,9 +79,25 @@ class Lock {
 
   private:
     char* name;				// for debugging
+
+    // Priority inheritance. A thread that has to wait in Acquire()
+    // donates its priority to the owner of the lock, and on to the
+    // owner of whatever lock that owner is waiting on, and so on.
+    // The donation is undone in Release(), where the releasing thread
+    // drops back to the highest priority still waiting on any lock it
+    // holds.
+
+    void DonatePriority(Thread *donor); // pass donor's priority down the
+					// chain of lock owners
+    void Requeue(Thread *waiter);	// waiter's priority has changed
+    void AddHolder(Thread *owner);	// add/remove this lock from the
+    void RemoveHolder(Thread *owner);	// owner's chain of held locks
+    static void UpdateDonation(Thread *t); // recompute t's donated priority
+
+    Lock *nextHeld;			// next lock held by the same thread
     
     // A wait queue is needed to keep track of threads that are
-    // "waiting" for a lock. This occurs when the the lock has already
+    // "waiting" for a lock. It is kept sorted by priority, highest first. This occurs when the the lock has already
     // been acquired by another thread, and this currentThread is
     // trying to do an Acquire().
     // Obviously, it cannot Acquire(), so the thread is placed into
@@ -81,6 +81,25 @@ SynchList::Remove()
     return item;
 }
 
+//----------------------------------------------------------------------
+// SynchList::TryRemove
+//      Remove an "item" from the beginning of the list, if there is
+//	one.  Never waits.
+// Returns:
+//	The removed item, or NULL if the list was empty.
+//----------------------------------------------------------------------
+
+void *
+SynchList::TryRemove()
+{
+    void *item;
+
+    lock->Acquire();			// enforce mutual exclusion
+    item = list->Remove();		// NULL if the list is empty
+    lock->Release();
+    return item;
+}
+
 //----------------------------------------------------------------------
 // SynchList::Mapcar
 //      Apply function to every item on the list.  Obey mutual exclusion
@@ -30,6 +30,8 @@ class SynchList {
 				// and wake up any thread waiting in remove
     void *Remove();		// remove the first item from the front of
 				// the list, waiting if the list is empty
+    void *TryRemove();		// remove the first item, or return NULL
+				// at once if the list is empty
 				// apply function to every item in the list
     void Mapcar(VoidFunctionPtr func);
 
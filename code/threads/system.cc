@@ -26,9 +26,6 @@ BitMap *bitmap;
 ProcessTable *processTable;
 
 int tlbCounter = 0;
-int fifoCounter = 0;
-int nextLockIndex = 0;
-int MAX_LOCKS = 1000;
 
 Lock *mailboxLock;
 int nextMailbox = 1;
@@ -38,16 +35,16 @@ int sys_alNumber   = 0;
 int al_lines[3];
 
 
-int nextCondIndex = 0;
-int MAX_CONDS = 1000; 
 
 int numProcesses = 0;
 int swapCounter = 0;
-KernelLock osLocks[1000];
-KernelCond osConds[1000];
+KernelLock *osLocks = NULL;
+int numOsLocks = 0;
+int freeOsLocks = -1;
+KernelCond *osConds = NULL;
+int numOsConds = 0;
+int freeOsConds = -1;
 
-int fifo[NumPhysPages];
- 
 OpenFile* swapFile;
 
 NewTranslationEntry *ipt;
@@ -66,12 +63,20 @@ Machine *machine;	// user program memory and registers
 
 #ifdef NETWORK
 PostOffice *postOffice;
+int numServers = 1;	// how many servers the Project 3 objects are
+			// spread over, on machines 0 .. numServers - 1
+bool sharedMemoryNetwork = FALSE; // send packets through shared memory 
+			// rings instead of sockets
 #endif
 
 
 // External definition, to allow us to take a pointer to this function
 extern void Cleanup();
 
+#ifdef USER_PROGRAM
+extern void SampleWorkingSets();	// in exception.cc
+#endif
+
 
 //----------------------------------------------------------------------
 // TimerInterruptHandler
@@ -80,6 +85,10 @@ extern void Cleanup();
 //	This routine is called each time there is a timer interrupt,
 //	with interrupts disabled.
 //
+//	The scheduler decides whether the interrupted thread should
+//	give up the CPU; under FIFO scheduling it always does.  With
+//	user programs, the timer also drives working set sampling.
+//
 //	Note that instead of calling Yield() directly (which would
 //	suspend the interrupt handler, not the interrupted thread
 //	which is what we wanted to context switch), we set a flag
@@ -93,7 +102,10 @@ extern void Cleanup();
 static void
 TimerInterruptHandler(int dummy)
 {
-    if (interrupt->getStatus() != IdleMode)
+#ifdef USER_PROGRAM
+    SampleWorkingSets();		// working sets and page fault frequency
+#endif
+    if (interrupt->getStatus() != IdleMode && scheduler->TimerTick())
 	interrupt->YieldOnReturn();
 }
 
@@ -114,6 +126,7 @@ Initialize(int argc, char **argv)
     int g;
     char* debugArgs = "";
     bool randomYield = FALSE;
+    bool mlfq = FALSE;			// multilevel feedback queue scheduling
     mailboxLock         = new Lock("MailboxLock");
     PageTableLock       = new Lock("PageTableLock");
     KernelLockTableLock = new Lock("KernelLockLock");
@@ -138,6 +151,8 @@ Initialize(int argc, char **argv)
     // Create the Inverted Page Table
     for(g = 0; g < NumPhysPages; g++) {
       ipt[g].valid = FALSE;
+      ipt[g].space = NULL;
+      ipt[g].pinned = 0;
     }
     
     // Create the file 
@@ -172,6 +187,12 @@ Initialize(int argc, char **argv)
 						// number generator
 	    randomYield = TRUE;
 	    argCount = 2;
+	} else if (!strcmp(*argv, "-mlfq")) {
+	    mlfq = TRUE;
+	} else if (!strcmp(*argv, "-sp")) {
+	    ASSERT(argc > 1);
+	    stackPoolLimit = atoi(*(argv + 1));	// max pooled thread stacks
+	    argCount = 2;
 	}
 #ifdef USER_PROGRAM
 	if (!strcmp(*argv, "-s"))
@@ -190,6 +211,13 @@ Initialize(int argc, char **argv)
 	    ASSERT(argc > 1);
 	    netname = atoi(*(argv + 1));
 	    argCount = 2;
+	} else if (!strcmp(*argv, "-shm")) {
+	    sharedMemoryNetwork = TRUE;
+	} else if (!strcmp(*argv, "-ns")) {
+	    ASSERT(argc > 1);
+	    numServers = atoi(*(argv + 1));
+	    ASSERT(numServers > 0);
+	    argCount = 2;
 	}
 #endif
     }
@@ -197,8 +225,10 @@ Initialize(int argc, char **argv)
     DebugInit(debugArgs);			// initialize DEBUG messages
     stats = new Statistics();			// collect statistics
     interrupt = new Interrupt;			// start up interrupt handling
-    scheduler = new Scheduler();		// initialize the ready queue
-    if (randomYield)				// start the timer (if needed)
+    scheduler = new Scheduler(mlfq ? MLFQ_SCHEDULING : FIFO_SCHEDULING);
+						// initialize the ready queue
+    if (randomYield || mlfq)			// start the timer (if needed);
+						// MLFQ needs it for quanta
 	timer = new Timer(TimerInterruptHandler, 0, randomYield);
 
     threadToBeDestroyed = NULL;
@@ -32,17 +32,12 @@ extern Timer *timer;				// the hardware alarm clock
 
 
 extern Lock *PageTableLock;
-extern int nextLockIndex;
 extern Lock *KernelLockTableLock;
-extern int MAX_LOCKS;
 
 extern int tlbCounter;
 extern OpenFile* swapFile;  
 
 extern int numProcesses;
-// FIFO code
-extern int fifo[];
-extern int fifoCounter;
 
 extern int swapCounter;
 
@@ -51,11 +46,24 @@ extern int nextMailbox;
 
 extern NewTranslationEntry *ipt;
 
+// The kernel lock and condition tables.  User programs name an entry
+// by a handle: the low HandleIndexBits bits are its slot and the rest
+// the slot's generation, which goes up each time the slot is freed, so
+// a stale handle is rejected even after its slot has been reused.  The
+// tables start with InitialKernelObjects slots and double when full,
+// up to MaxKernelObjects; freed slots are kept on a free list.
+#define HandleIndexBits 16
+#define MaxKernelObjects (1 << HandleIndexBits)
+#define InitialKernelObjects 64
+
 struct KernelLock {
   Lock* lock;
-  AddrSpace* as;
-  int usageCounter;
+  AddrSpace* as;	// the process that owns the lock
+  int usageCounter;	// threads holding it or waiting to
   bool toBeDestroyed;
+  bool inUse;
+  int generation;
+  int nextFree;		// next slot on the free list
 };
 
 extern int sys_passNumber;
@@ -63,22 +71,27 @@ extern int sys_alNumber;
 extern int al_lines[];
 
 
-extern KernelLock osLocks[];
+extern KernelLock *osLocks;
+extern int numOsLocks;		// slots in osLocks
+extern int freeOsLocks;		// first free slot, -1 if none
 
 extern BitMap* bitmap;
 
-extern int nextCondIndex;
 extern Lock *KernelCondTableLock;
-extern int MAX_CONDS;
 
 struct KernelCond {
   Condition *condition;
-  int usageCounter;
+  int usageCounter;	// threads waiting on it
   bool toBeDestroyed;
-  AddrSpace* as;
+  AddrSpace* as;	// the process that owns the condition
+  bool inUse;
+  int generation;
+  int nextFree;		// next slot on the free list
 };
 
-extern KernelCond osConds[];
+extern KernelCond *osConds;
+extern int numOsConds;		// slots in osConds
+extern int freeOsConds;		// first free slot, -1 if none
 
 extern ProcessTable *processTable;
 
@@ -101,6 +114,8 @@ extern SynchDisk   *synchDisk;
 #ifdef NETWORK
 #include "post.h"
 extern PostOffice* postOffice;
+extern int numServers;
+extern bool sharedMemoryNetwork;
 #endif
 
 #endif // SYSTEM_H
@@ -24,6 +24,83 @@
 					// execution stack, for detecting 
 					// stack overflows
 
+int stackPoolLimit = DefaultStackPoolLimit;
+static int *stackPool = NULL;		// stacks of finished threads, linked
+					// through their first word
+static int stackPoolSize = 0;
+
+//----------------------------------------------------------------------
+// GetStack, PutStack
+//	Allocate and free thread stacks, going through the stack pool.
+//	A stack from AllocBoundedArray has its guard pages set up with
+//	mprotect; keeping freed stacks around lets the next thread
+//	reuse them without any more host system calls.
+//----------------------------------------------------------------------
+
+static int *
+GetStack()
+{
+    int *s = stackPool;
+
+    if (s == NULL) {
+	stats->numStackAllocs++;
+	return (int *) AllocBoundedArray(StackSize * sizeof(int));
+    }
+    stats->numStackPoolHits++;
+    stackPool = *((int **) s);
+    stackPoolSize--;
+    return s;
+}
+
+static void
+PutStack(int *s)
+{
+    if (stackPoolSize >= stackPoolLimit) {
+	DeallocBoundedArray((char *) s, StackSize * sizeof(int));
+	return;
+    }
+    *((int **) s) = stackPool;
+    stackPool = s;
+    stackPoolSize++;
+}
+
+//----------------------------------------------------------------------
+// Thread::operator new, Thread::operator delete
+// 	Allocate thread control blocks (registers, machine state and
+//	all) from slabs of ThreadSlabSize, and keep deleted ones on a
+//	free list for the next "new Thread", so forking a thread in
+//	steady state doesn't touch the heap.  Slabs are never freed.
+//----------------------------------------------------------------------
+
+Thread *Thread::freeList = NULL;
+
+void *
+Thread::operator new(size_t size)
+{
+    Thread *t;
+
+    ASSERT(size == sizeof(Thread));
+    if (freeList == NULL) {
+	Thread *slab = (Thread *) ::operator new(ThreadSlabSize * sizeof(Thread));
+	for (int i = 0; i < ThreadSlabSize; i++) {
+	    *((Thread **) &slab[i]) = freeList;
+	    freeList = &slab[i];
+	}
+    }
+    t = freeList;
+    freeList = *((Thread **) t);
+    return (void *) t;
+}
+
+void
+Thread::operator delete(void *ptr)
+{
+    if (ptr == NULL)
+	return;
+    *((Thread **) ptr) = freeList;
+    freeList = (Thread *) ptr;
+}
+
 //----------------------------------------------------------------------
 // Thread::Thread
 // 	Initialize a thread control block, so that we can then call
@@ -38,6 +115,11 @@ Thread::Thread(char* threadName)
     stackTop = NULL;
     stack = NULL;
     status = JUST_CREATED;
+    priority = basePriority = DefaultPriority;
+    quantumUsed = 0;
+    donatedPriority = MinPriority - 1;
+    waitingOn = NULL;
+    locksHeld = NULL;
 #ifdef USER_PROGRAM
     space = NULL;
 #endif
@@ -61,7 +143,7 @@ Thread::~Thread()
 
     ASSERT(this != currentThread);
     if (stack != NULL)
-	DeallocBoundedArray((char *) stack, StackSize * sizeof(int));
+	PutStack(stack);
 }
 
 //----------------------------------------------------------------------
@@ -147,6 +229,12 @@ Thread::Finish ()
     ASSERT(this == currentThread);
     
     DEBUG('t', "Finishing thread \"%s\"\n", getName());
+
+    // give up any locks we still hold, so that no lock (or the priority
+    // donation chain) is left pointing at us once we are destroyed
+    while (locksHeld != NULL)
+	locksHeld->Release();
+    ASSERT(waitingOn == NULL);
     
     threadToBeDestroyed = currentThread;
     Sleep();					// invokes SWITCH
@@ -168,6 +256,12 @@ Thread::Finish ()
 //	atomically.  On return, we re-set the interrupt level to its
 //	original state, in case we are called with interrupts disabled. 
 //
+//	If nothing else is ready we don't bother disabling interrupts and
+//	going through the scheduler; nothing can change the ready list
+//	until simulated time advances.  We still advance it by one tick,
+//	as re-enabling interrupts would have, so that a thread spinning
+//	on Yield sees its pending interrupts go off.
+//
 // 	Similar to Thread::Sleep(), but a little different.
 //----------------------------------------------------------------------
 
@@ -175,9 +269,17 @@ void
 Thread::Yield ()
 {
     Thread *nextThread;
-    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    IntStatus oldLevel;
     
     ASSERT(this == currentThread);
+
+    if (scheduler->NoneReady()) {
+	if (interrupt->getLevel() == IntOn)
+	    interrupt->OneTick();
+	return;
+    }
+
+    oldLevel = interrupt->SetLevel(IntOff);
     
     DEBUG('t', "Yielding thread \"%s\"\n", getName());
     
@@ -245,6 +347,9 @@ void ThreadPrint(int arg){ Thread *t = (Thread *)arg; t->Print(); }
 //		calls (*func)(arg)
 //		calls Thread::Finish
 //
+//	The stack may be a recycled one from the stack pool, so the
+//	fencepost is always rewritten.
+//
 //	"func" is the procedure to be forked
 //	"arg" is the parameter to be passed to the procedure
 //----------------------------------------------------------------------
@@ -252,7 +357,7 @@ void ThreadPrint(int arg){ Thread *t = (Thread *)arg; t->Print(); }
 void
 Thread::StackAllocate (VoidFunctionPtr func, int arg)
 {
-    stack = (int *) AllocBoundedArray(StackSize * sizeof(int));
+    stack = GetStack();
 
 #ifdef HOST_SNAKE
     // HP stack works from low addresses to high addresses
@@ -55,10 +55,33 @@
 // WATCH OUT IF THIS ISN'T BIG ENOUGH!!!!!
 #define StackSize	(4 * 1024)	// in words
 
+// Stacks of finished threads are kept on a free list, up to this many
+// by default, so that creating a thread doesn't have to go to the host
+// for a new (guard page protected) stack.  Set with -sp.
+#define DefaultStackPoolLimit	64
+
+extern int stackPoolLimit;		// max stacks kept in the pool
+
+// Thread control blocks are carved out of slabs of this many at a
+// time, and go back on a free list when deleted (see Thread::operator
+// new).  Finished threads are reaped in batches of ReapBatchSize.
+#define ThreadSlabSize		32
+#define ReapBatchSize		8
+
+
+class Lock;
 
 // Thread state
 enum ThreadStatus { JUST_CREATED, RUNNING, READY, BLOCKED };
 
+// Thread priorities, used by the multilevel feedback queue scheduler.
+// Larger numbers are more important; every thread starts out at
+// DefaultPriority unless it is changed with setPriority before Fork.
+#define NumPriorityLevels	4
+#define MinPriority		0
+#define MaxPriority		(NumPriorityLevels - 1)
+#define DefaultPriority		(MaxPriority - 1)
+
 // external function, dummy routine whose sole job is to call Thread::Print
 extern void ThreadPrint(int arg);	 
 
@@ -87,6 +110,9 @@ class Thread {
 					// must not be running when delete 
 					// is called
 
+    void *operator new(size_t size);	// allocate from the thread slabs
+    void operator delete(void *ptr);	// return to the thread slabs
+
     // basic thread operations
 
     void Fork(VoidFunctionPtr func, int arg); 	// Make thread run (*func)(arg)
@@ -99,15 +125,38 @@ class Thread {
     void CheckOverflow();   			// Check if thread has 
 						// overflowed its stack
     void setStatus(ThreadStatus st) { status = st; }
+    ThreadStatus getStatus() { return status; }
     char* getName() { return (name); }
     void Print() { printf("%s, ", name); }
     void setStack(int* s) { stackTop = s; }
 
     void setMailbox(int boxNum) { mailbox = boxNum; } 
     int getMailbox() { return mailbox; }
+
+    // scheduling priority; "basePriority" is what the thread was given,
+    // "priority" is the level the MLFQ scheduler currently has it at,
+    // and getPriority also takes into account any priority donated 
+    // by threads waiting on locks this thread holds
+    void setPriority(int p) { basePriority = priority = p; }
+    int getPriority() 
+	{ return (donatedPriority > priority) ? donatedPriority : priority; }
+    int getCurrentPriority() { return priority; }
+    int getBasePriority() { return basePriority; }
+    void setCurrentPriority(int p) { priority = p; }
+    int quantumUsed;			// timer interrupts charged at
+					// the current priority level
+
+    // priority inheritance bookkeeping, maintained by Lock
+    int donatedPriority;		// highest priority of any thread
+					// waiting on a lock we hold, or
+					// MinPriority - 1 if none
+    Lock *waitingOn;			// lock we are blocked in Acquire on
+    Lock *locksHeld;			// chain of locks we hold
   private:
     // some of the private data for this class is listed above
     int mailbox;
+    int priority;
+    int basePriority;
     int* stack; 	 		// Bottom of the stack 
 					// NULL if this is the main thread
 					// (If NULL, don't deallocate stack)
@@ -117,6 +166,8 @@ class Thread {
     void StackAllocate(VoidFunctionPtr func, int arg);
     					// Allocate a stack for thread.
 					// Used internally by Fork()
+
+    static Thread *freeList;		// unused thread control blocks
     
 
 #ifdef USER_PROGRAM
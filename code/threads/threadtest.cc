@@ -1252,6 +1252,8 @@ void AirportSimulation() {
   name = new char[20];
   name = "AirportManager";
   t = new Thread(name);
+  // the manager must not starve behind the passengers under -mlfq
+  t->setPriority(MaxPriority);
   t->Fork((VoidFunctionPtr)AirportManager,1);
   
   if(current_test == 0) {
@@ -143,6 +143,25 @@ AddrSpace::AddrSpace(OpenFile *executable) : fileTable(MaxOpenFiles) {
 
     numCodePages = divRoundUp(noffH.code.size, PageSize);
     numInitPages = divRoundUp(noffH.initData.size, PageSize);
+    codeInFileAddr = noffH.code.inFileAddr;
+
+    lastFault = -1;
+    faultStride = 0;
+    faultStreak = 0;
+    prefetching = FALSE;
+
+    swapLoc = new int[numPages];
+    for (i = 0; i < numPages; i++)
+      swapLoc[i] = -1;
+    for (i = 0; i < MaxMappings; i++)
+      mappings[i].file = NULL;
+    locksOwned = condsOwned = 0;
+    numThreads = 1;			// the thread we are created for
+    residentPages = 0;
+    frameLimit = NumPhysPages;		// no limit until PFF says otherwise
+    workingSet = 0;
+    faultsThisSample = 0;
+    lastSample = 0;
 
     // Virtual memory is implemented so numPages can be greater
     ASSERT(numPages <= NumPhysPages);		
@@ -161,7 +180,7 @@ AddrSpace::AddrSpace(OpenFile *executable) : fileTable(MaxOpenFiles) {
     //bzero(machine->mainMemory, size);
     for (i = 0; i < numPages; i++) {
       index = bitmap->Find();
-      if(index == -1) {
+      if((int)index == -1) {
 	// If index is -1, then the bitmap is full
 	// and there are no available pages in physical page table
 	DEBUG('a',"Bitmap is full");
@@ -217,15 +236,38 @@ AddrSpace::AddrSpace(OpenFile *executable) : fileTable(MaxOpenFiles) {
 }
 
 void AddrSpace::memoryLoad(int vpnumber, int index) {
-  NoffHeader noffH;
-	    	      
-  asExecutable->ReadAt((char *)&noffH, sizeof(noffH), 0);
-  // Read this into memory
+  // Read this into memory. The header was read once in the constructor,
+  // so this is a single read of the executable
   asExecutable->ReadAt(&(machine->mainMemory[index*PageSize]),PageSize,
-					     (vpnumber*PageSize)+noffH.code.inFileAddr);
+					     (vpnumber*PageSize)+codeInFileAddr);
 
 }
 
+//----------------------------------------------------------------------
+// AddrSpace::FaultStride
+// 	Record a page fault on "vpnumber" and look for a pattern.  If
+//	the last PrefetchTrigger faults have all been the same distance
+//	apart, return that distance so the caller can prefetch the next
+//	pages along it; otherwise return 0.
+//----------------------------------------------------------------------
+
+int AddrSpace::FaultStride(int vpnumber) {
+  int stride = (lastFault == -1) ? 0 : vpnumber - lastFault;
+
+  if(stride != 0 && stride == faultStride) {
+    faultStreak++;
+  } else {
+    faultStride = stride;
+    faultStreak = 1;
+  }
+  lastFault = vpnumber;
+
+  if(faultStride == 0 || faultStreak < PrefetchTrigger) {
+    return 0;
+  }
+  return faultStride;
+}
+
 //----------------------------------------------------------------------
 // AddrSpace::~AddrSpace
 //
@@ -235,7 +277,9 @@ void AddrSpace::memoryLoad(int vpnumber, int index) {
 
 AddrSpace::~AddrSpace()
 {
+    scheduler->ForgetSpace(this);
     delete pageTable;
+    delete [] swapLoc;
 }
 
 //----------------------------------------------------------------------
@@ -293,6 +337,10 @@ void AddrSpace::SaveState()
 //	this address space can run.
 //
 //      For now, tell the machine where to find the page table.
+//	TLB entries are tagged with the id of the address space that
+//	loaded them, so switching the machine's current id is enough;
+//	the TLB doesn't need to be flushed, and our own entries are
+//	still there when we get switched back in.
 //----------------------------------------------------------------------
 
 void AddrSpace::RestoreState() 
@@ -302,7 +350,8 @@ void AddrSpace::RestoreState()
   PageTableLock->Acquire();
   machine->pageTable = pageTable;
   machine->pageTableSize = numPages;
-  
+
+  machine->currentAsid = id;
 
 
   PageTableLock->Release();
@@ -318,7 +367,7 @@ void AddrSpace::NewPageTable() {
     TranslationEntry *newPageTable;
     newPageTable = new TranslationEntry[numPages+8];
 
-    for (i = 0; i < numPages; i++) {
+    for (i = 0; i < (int)numPages; i++) {
       newPageTable[i].virtualPage = pageTable[i].virtualPage; 
       newPageTable[i].physicalPage = pageTable[i].physicalPage;
       newPageTable[i].valid       = pageTable[i].valid;
@@ -329,7 +378,7 @@ void AddrSpace::NewPageTable() {
                                                             // pages to be read-only   
     }
     // Allocate space for new stack in address
-    for(i = numPages; i < (numPages+8); i++) {
+    for(i = numPages; i < (int)(numPages+8); i++) {
       index = bitmap->Find();
       if(index == -1) {
 	// If index is -1, then the bitmap is full
@@ -344,6 +393,14 @@ void AddrSpace::NewPageTable() {
       newPageTable[i].dirty        = FALSE;
       newPageTable[i].readOnly     = FALSE;
     }
+    // the new stack pages have never been swapped out
+    int *newSwapLoc = new int[numPages+8];
+    for (i = 0; i < (int)numPages+8; i++) {
+      newSwapLoc[i] = (i < (int)numPages) ? swapLoc[i] : -1;
+    }
+    delete[] swapLoc;
+    swapLoc = newSwapLoc;
+
     // delete old page table
     delete[] pageTable;
 
@@ -359,6 +416,86 @@ void AddrSpace::NewPageTable() {
     interrupt->SetLevel(old);
 }
 
+//----------------------------------------------------------------------
+// AddrSpace::Mmap
+// 	Map the first "length" bytes of "file" into new pages at the end
+//	of the address space.  No frames are allocated here; the page
+//	fault handler reads each page from the file the first time it is
+//	touched.  Returns the first virtual page of the mapping, or -1 if
+//	all MaxMappings slots are in use.
+//----------------------------------------------------------------------
+
+int AddrSpace::Mmap(OpenFile *file, int length) {
+  MappedFile *m = NULL;
+  int i, pages;
+
+  for (i = 0; i < MaxMappings; i++) {
+    if (mappings[i].file == NULL) {
+      m = &mappings[i];
+      break;
+    }
+  }
+  if (m == NULL || length <= 0) {
+    return -1;
+  }
+  pages = divRoundUp(length, PageSize);
+
+  IntStatus old = interrupt->SetLevel(IntOff);
+  PageTableLock->Acquire();
+  TranslationEntry *newPageTable = new TranslationEntry[numPages+pages];
+  int *newSwapLoc = new int[numPages+pages];
+
+  for (i = 0; i < (int)numPages; i++) {
+    newPageTable[i] = pageTable[i];
+    newSwapLoc[i] = swapLoc[i];
+  }
+  for (i = numPages; i < (int)numPages+pages; i++) {
+    newPageTable[i].virtualPage  = i;
+    newPageTable[i].physicalPage = -1;	// not in memory until touched
+    newPageTable[i].valid        = TRUE;
+    newPageTable[i].use          = FALSE;
+    newPageTable[i].dirty        = FALSE;
+    newPageTable[i].readOnly     = FALSE;
+    newSwapLoc[i] = -1;
+  }
+  delete[] pageTable;
+  delete[] swapLoc;
+  pageTable = newPageTable;
+  swapLoc = newSwapLoc;
+
+  m->file = file;
+  m->firstPage = numPages;
+  m->numPages = pages;
+  m->length = length;
+
+  numPages = numPages+pages;
+  machine->pageTable = pageTable;
+  machine->pageTableSize = numPages;
+
+  PageTableLock->Release();
+  interrupt->SetLevel(old);
+  return m->firstPage;
+}
+
+MappedFile *AddrSpace::FindMapping(int vpnumber) {
+  for (int i = 0; i < MaxMappings; i++) {
+    if (mappings[i].file != NULL && vpnumber >= mappings[i].firstPage &&
+	vpnumber < mappings[i].firstPage + mappings[i].numPages) {
+      return &mappings[i];
+    }
+  }
+  return NULL;
+}
+
+bool AddrSpace::IsMapped(OpenFile *file) {
+  for (int i = 0; i < MaxMappings; i++) {
+    if (mappings[i].file == file) {
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
 void AddrSpace::DeAllocate(int stackLocation){
   PageTableLock->Acquire();
   /*
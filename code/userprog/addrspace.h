@@ -24,6 +24,49 @@
 #define MaxOpenFiles 256
 #define MaxChildSpaces 256
 
+// Page fault prefetching.  Once PrefetchTrigger faults in a row have
+// been the same distance apart (a sequential or strided walk through
+// an array), the next PrefetchDepth pages along that stride are read
+// in as one batch, by a separate kernel thread, ahead of the faults.
+#define PrefetchTrigger 2
+#define PrefetchDepth 4
+
+// Working sets and page fault frequency.  Every WSSampleInterval timer
+// interrupts the use bits of all frames are sampled; a page is in its
+// process's working set if it was used in the last WSWindow samples.
+// At each sample a process faulting more than PFFUpper times gets
+// PFFStep more frames, and one faulting less than PFFLower times gives
+// PFFStep back (but never below its working set or MinFrameLimit).  A
+// process at its limit replaces its own pages instead of taking more.
+#define WSSampleInterval 4
+#define WSWindow 4
+#define PFFUpper 8
+#define PFFLower 2
+#define PFFStep 8
+#define MinFrameLimit 8
+
+// Pageout.  When a page fault leaves fewer than FreeFrameReserve frames
+// free, the pageout daemon wakes up and evicts pages until there are
+// FreeFrameTarget free, writing dirty ones to the swap file up to
+// PageoutBatch pages at a time.
+#define FreeFrameReserve 32
+#define FreeFrameTarget 64
+#define PageoutBatch 8
+
+// Memory mapped files.  Each address space can have up to MaxMappings
+// files mapped at once.  Mapped pages are read from the file when they
+// are first touched, and written back to it (not to swap) when they
+// are evicted dirty or unmapped.
+#define MaxMappings 16
+
+class MappedFile {
+  public:
+    OpenFile *file;			// NULL if the slot is free
+    int firstPage;			// first virtual page of the mapping
+    int numPages;			// pages in the mapping
+    int length;				// bytes of the file that are mapped
+};
+
 class AddrSpace {
   public:
     AddrSpace(OpenFile *executable);	// Create an address space,
@@ -48,12 +91,43 @@ class AddrSpace {
     void memoryLoad(int vpnumber, int index);
     void setMailbox(int mbox) { mailbox = mbox; }
     int getMailbox() { return mailbox; }
+
+    int FaultStride(int vpnumber);	// record a page fault; returns the
+					// stride to prefetch along, or 0
+    bool prefetching;			// a prefetch thread is running
+    int prefetchFrom, prefetchStride;	// what it should prefetch
+
+    int Mmap(OpenFile *file, int length);	// map file at the end of the
+					// address space; returns the first
+					// virtual page, or -1
+    MappedFile *FindMapping(int vpnumber);	// the mapping vpnumber is
+					// in, or NULL
+    bool IsMapped(OpenFile *file);	// TRUE if file is mapped
+    MappedFile mappings[MaxMappings];
+
+    int locksOwned;			// kernel locks and conditions we
+    int condsOwned;			// created and haven't destroyed
+    int numThreads;			// user threads that haven't exited
+
+    int *swapLoc;			// swap file slot of each virtual
+					// page, -1 if it has never been
+					// written to swap
+    int residentPages;			// frames in the IPT we own
+    int frameLimit;			// frames we may own, set by PFF
+    int workingSet;			// last working set estimate
+    int faultsThisSample;		// page loads since the last sample
+    int lastSample;			// sample we were last adjusted in
  private:
 					// for now!
     unsigned int numPages;		// Number of pages in the virtual 
 					// address space
     int numCodePages, numInitPages;
     int mailbox;
+    int codeInFileAddr;			// where the code starts in the
+					// executable, for memoryLoad
+    int lastFault;			// vpn of the last page fault
+    int faultStride;			// distance between the last two
+    int faultStreak;			// faults in a row at faultStride
 };
 
 class ChildProcess {
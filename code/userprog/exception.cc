@@ -29,6 +29,9 @@
 #include <iostream>
 #include <sstream>
 #include <string>
+#ifdef NETWORK
+#include "message.h"
+#endif
 
 using namespace std;
 
@@ -36,6 +39,7 @@ struct TokenRequest {
   int tokenNum;
   int mailboxNum;
   int machineNum;
+  int seq;		// of the Acquire request, for the reply
 };
 
 struct Member {
@@ -43,11 +47,19 @@ struct Member {
   int mailboxNum;
 };
 
-Member clients[1000];
+#ifdef NETWORK
+struct NetRequest {
+  Message msg;
+  int machineNum;	// who sent it, for the reply
+  int mailboxNum;
+};
+#endif
 
-enum RequestType { UNKNOWN, CREATE_LOCK, ACQUIRE, RELEASE, DESTROY_LOCK, CREATE_CONDITION, WAIT, SIGNAL, BROADCAST, REGISTER, CREATE_MV, GET, SET, TOKEN, REGISTER_RESPONSE };
+Member clients[1000];
 
-RequestType getNetThreadRequestType(char* req);
+bool UnmapFrame(int frame);
+int FindIPTEntry(int processId, int vpn);
+bool HandlePageFault(int vaddress);
 
 int copyin(unsigned int vaddr, int len, char *buf) {
     // Copy len bytes from the current thread's virtual address vaddr.
@@ -160,6 +172,36 @@ int Open_Syscall(unsigned int vaddr, int len) {
 	return -1;
 }
 
+int PinUserPage(unsigned int vaddr, bool writing) {
+    // Translate vaddr so the kernel can transfer data straight to or
+    // from the user's frame, faulting the page in if it isn't in
+    // memory. The frame is pinned so it can't be evicted while the
+    // transfer blocks; call UnpinUserPage when done.  Returns the
+    // physical address, or -1 for a bad address.
+    int paddr;
+    ExceptionType exception;
+
+    while ( (exception = machine->Translate(vaddr, &paddr, 1, writing)) ==
+	    PageFaultException ) {
+	if ( !HandlePageFault(vaddr) ) {
+	    return -1;
+	}
+    }
+    if ( exception != NoException ) {
+	return -1;
+    }
+    ipt[paddr / PageSize].pinned++;
+    if ( writing ) {
+	// the TLB entry might be replaced before the transfer is over
+	ipt[paddr / PageSize].dirty = TRUE;
+    }
+    return paddr;
+}
+
+void UnpinUserPage(int paddr) {
+    ipt[paddr / PageSize].pinned--;
+}
+
 void Write_Syscall(unsigned int vaddr, int len, int id) {
     // Write the buffer to the given disk file.  If ConsoleOutput is
     // the fileID, data goes to the synchronized console instead.  If
@@ -167,38 +209,41 @@ void Write_Syscall(unsigned int vaddr, int len, int id) {
     // console exists, create one. For disk files, the file is looked
     // up in the current address space's open file table and used as
     // the target of the write.
+    //
+    // The data is written straight out of the user's frames, one page
+    // at a time, rather than copied into a kernel buffer first.
     
-    char *buf;		// Kernel buffer for output
-    OpenFile *f;	// Open file for output
+    OpenFile *f = NULL;	// Open file for output
+    int paddr;		// Physical address of the current piece
+    int chunk;		// Bytes of the buffer on the current page
 
     if ( id == ConsoleInput) return;
-    
-    if ( !(buf = new char[len]) ) {
-	printf("%s","Error allocating kernel buffer for write!\n");
+
+    if ( id != ConsoleOutput &&
+	 !(f = (OpenFile *) currentThread->space->fileTable.Get(id)) ) {
+	printf("%s","Bad OpenFileId passed to Write\n");
 	return;
-    } else {
-        if ( copyin(vaddr,len,buf) == -1 ) {
+    }
+
+    while ( len > 0 ) {
+	chunk = PageSize - (vaddr % PageSize);
+	if ( chunk > len )
+	    chunk = len;
+	if ( (paddr = PinUserPage(vaddr, FALSE)) == -1 ) {
 	    printf("%s","Bad pointer passed to to write: data not written\n");
-	    delete[] buf;
 	    return;
 	}
-    }
-
-    if ( id == ConsoleOutput) {
-      for (int ii=0; ii<len; ii++) {
-	printf("%c",buf[ii]);
-      }
-
-    } else {
-	if ( (f = (OpenFile *) currentThread->space->fileTable.Get(id)) ) {
-	    f->Write(buf, len);
+	if ( id == ConsoleOutput) {
+	    for (int ii=0; ii<chunk; ii++) {
+		printf("%c",machine->mainMemory[paddr+ii]);
+	    }
 	} else {
-	    printf("%s","Bad OpenFileId passed to Write\n");
-	    len = -1;
+	    f->Write(&(machine->mainMemory[paddr]), chunk);
 	}
+	UnpinUserPage(paddr);
+	vaddr += chunk;
+	len -= chunk;
     }
-
-    delete[] buf;
 }
 
 int Read_Syscall(unsigned int vaddr, int len, int id) {
@@ -207,45 +252,69 @@ int Read_Syscall(unsigned int vaddr, int len, int id) {
     // a Write arrives for the synchronized Console, and no such
     // console exists, create one.    We reuse len as the number of bytes
     // read, which is an unnessecary savings of space.
+    //
+    // Disk files are read straight into the user's frames, one page at
+    // a time; only console input goes through a kernel buffer.
     char *buf;		// Kernel buffer for input
     OpenFile *f;	// Open file for output
+    int paddr;		// Physical address of the current piece
+    int chunk;		// Bytes of the buffer on the current page
+    int n;		// Bytes read into the current piece
+    int total = 0;	// Bytes read so far
 
     if ( id == ConsoleOutput) return -1;
     
-    if ( !(buf = new char[len]) ) {
+    if ( id == ConsoleInput) {
+      if ( !(buf = new char[len]) ) {
 	printf("%s","Error allocating kernel buffer in Read\n");
 	return -1;
-    }
+      }
 
-    if ( id == ConsoleInput) {
       //Reading from the keyboard
       scanf("%s", buf);
 
       if ( copyout(vaddr, len, buf) == -1 ) {
 	printf("%s","Bad pointer passed to Read: data not copied\n");
       }
-    } else {
-	if ( (f = (OpenFile *) currentThread->space->fileTable.Get(id)) ) {
-	    len = f->Read(buf, len);
-	    if ( len > 0 ) {
-	        //Read something from the file. Put into user's address space
-  	        if ( copyout(vaddr, len, buf) == -1 ) {
-		    printf("%s","Bad pointer passed to Read: data not copied\n");
-		}
-	    }
-	} else {
-	    printf("%s","Bad OpenFileId passed to Read\n");
-	    len = -1;
-	}
+      delete[] buf;
+      return len;
     }
 
-    delete[] buf;
-    return len;
+    if ( !(f = (OpenFile *) currentThread->space->fileTable.Get(id)) ) {
+	printf("%s","Bad OpenFileId passed to Read\n");
+	return -1;
+    }
+
+    while ( total < len ) {
+	chunk = PageSize - (vaddr % PageSize);
+	if ( chunk > len - total )
+	    chunk = len - total;
+	if ( (paddr = PinUserPage(vaddr, TRUE)) == -1 ) {
+	    printf("%s","Bad pointer passed to Read: data not copied\n");
+	    break;
+	}
+	n = f->Read(&(machine->mainMemory[paddr]), chunk);
+	UnpinUserPage(paddr);
+	if ( n <= 0 )
+	    break;
+	total += n;
+	vaddr += n;
+	if ( n < chunk )
+	    break;		// end of file
+    }
+    return total;
 }
 
 void Close_Syscall(int fd) {
     // Close the file associated with id fd.  No error reporting.
-    OpenFile *f = (OpenFile *) currentThread->space->fileTable.Remove(fd);
+    // A file that is mapped stays open until it is unmapped.
+    OpenFile *f = (OpenFile *) currentThread->space->fileTable.Get(fd);
+
+    if ( f && currentThread->space->IsMapped(f) ) {
+      printf("%s","Tried to close a mapped file\n");
+      return;
+    }
+    f = (OpenFile *) currentThread->space->fileTable.Remove(fd);
 
     if ( f ) {
       delete f;
@@ -254,29 +323,233 @@ void Close_Syscall(int fd) {
     }
 }
 
+int Mmap_Syscall(int id, int len) {
+    // Map the first len bytes of open file id into the address space
+    // and return the virtual address of the mapping, or -1.  Nothing
+    // is read here; the page fault handler loads each page from the
+    // file when it is touched.
+    OpenFile *f = (OpenFile *) currentThread->space->fileTable.Get(id);
+    int vpn;
+
+    if ( !f ) {
+	printf("%s","Bad OpenFileId passed to Mmap\n");
+	return -1;
+    }
+    if ( (vpn = currentThread->space->Mmap(f, len)) == -1 ) {
+	printf("%s","Can't map file in Mmap\n");
+	return -1;
+    }
+    return vpn * PageSize;
+}
+
+void Munmap_Syscall(int vaddr) {
+    // Remove the mapping that starts at vaddr. Pages of it that are in
+    // memory are written back to the file if they are dirty, and their
+    // frames freed. The addresses aren't reused by later mappings: their
+    // page table entries are made invalid, so touching them afterwards
+    // is an address error.
+    AddrSpace *space = currentThread->space;
+    MappedFile *m = space->FindMapping(vaddr / PageSize);
+    int vpn, frame, i;
+
+    if ( !m || m->firstPage * PageSize != vaddr ) {
+	printf("%s","Bad address passed to Munmap\n");
+	return;
+    }
+
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    for (vpn = m->firstPage; vpn < m->firstPage + m->numPages; vpn++) {
+	if ( (frame = FindIPTEntry(space->id, vpn)) != -1 ) {
+	    UnmapFrame(frame);
+	    bitmap->Clear(frame);
+	}
+	for (i = 0; machine->tlb != NULL && i < TLBSize; i++) {
+	    if ( machine->tlb[i].valid && machine->tlb[i].asid == space->id &&
+		 machine->tlb[i].virtualPage == vpn ) {
+		machine->tlb[i].valid = FALSE;
+	    }
+	}
+	space->pageTable[vpn].valid = FALSE;
+    }
+    m->file = NULL;
+    interrupt->SetLevel(oldLevel);
+}
+
 /* New Syscalls
  * Acquire, Release, Wait, Signal, Broadcast
  *
  */
 
-int CreateLock_Syscall(int vaddr) {
-#ifndef NETWORK
+//----------------------------------------------------------------------
+// The kernel lock and condition tables (see system.h).  The caller of
+// each of these holds the table's lock.
+//----------------------------------------------------------------------
+
+template <class T>
+int AllocSlot(T *&table, int &size, int &freeList) {
+  // Take a slot off the free list, doubling the table first if the
+  // list is empty. The slot is given to the current process. Returns
+  // the slot, or -1 if the table is as big as it can get.
+  int i, slot;
+
+  if(freeList == -1) {
+    int newSize = (size == 0) ? InitialKernelObjects : size * 2;
+    if(newSize > MaxKernelObjects) {
+      return -1;
+    }
+    T *newTable = new T[newSize];
+    for(i = 0; i < size; i++) {
+      newTable[i] = table[i];
+    }
+    for(i = size; i < newSize; i++) {
+      newTable[i].inUse = FALSE;
+      newTable[i].generation = 0;
+      newTable[i].nextFree = (i + 1 < newSize) ? i + 1 : -1;
+    }
+    delete[] table;
+    table = newTable;
+    freeList = size;
+    size = newSize;
+  }
+  slot = freeList;
+  freeList = table[slot].nextFree;
+  table[slot].inUse = TRUE;
+  table[slot].usageCounter = 0;
+  table[slot].toBeDestroyed = FALSE;
+  table[slot].as = currentThread->space;
+  return slot;
+}
+
+template <class T>
+void FreeSlot(T *table, int &freeList, int slot) {
+  // Put a slot back on the free list. Its generation goes up, so
+  // handles to what was in it don't work any more.
+  table[slot].inUse = FALSE;
+  table[slot].generation = (table[slot].generation + 1) &
+    ((1 << (31 - HandleIndexBits)) - 1);
+  table[slot].nextFree = freeList;
+  freeList = slot;
+}
+
+template <class T>
+T *LookupSlot(T *table, int size, int handle) {
+  // Return the entry a handle from a user program names, or NULL if
+  // it doesn't name one: it's out of range, what it named has been
+  // destroyed (even if the slot has since been reused), or it belongs
+  // to another process.
+  int slot = handle & (MaxKernelObjects - 1);
+
+  if(handle < 0 || slot >= size || !table[slot].inUse ||
+     table[slot].generation != (handle >> HandleIndexBits)) {
+    DEBUG('q',"BAD HANDLE %d\n", handle);
+    return NULL;
+  }
+  if(table[slot].as != currentThread->space) {
+    DEBUG('q',"%s : HANDLE %d BELONGS TO DIFFERENT PROCESS\n", currentThread->getName(), handle);
+    return NULL;
+  }
+  return &table[slot];
+}
+
+int SlotHandle(int generation, int slot) {
+  return (generation << HandleIndexBits) | slot;
+}
+
+void DestroyKernelLock(int slot) {
+  DEBUG('q',"DESTROYING LOCK\n");
+  osLocks[slot].as->locksOwned--;
+  delete osLocks[slot].lock;
+  osLocks[slot].lock = NULL;
+  FreeSlot(osLocks, freeOsLocks, slot);
+}
+
+void DestroyKernelCond(int slot) {
+  DEBUG('q',"DESTROYING CONDITION\n");
+  osConds[slot].as->condsOwned--;
+  delete osConds[slot].condition;
+  osConds[slot].condition = NULL;
+  FreeSlot(osConds, freeOsConds, slot);
+}
+
+void ReleaseKernelLocks() {
+  // Release the kernel locks the current thread holds as it exits, as
+  // Release_Syscall would, so a deferred DestroyLock still happens
+  int i;
+
   KernelLockTableLock->Acquire();
- //IS OK???
-  // Return position in kernel structure array
-  int size = 16;
-  int max_chars = 20;
+  for(i = 0; i < numOsLocks; i++) {
+    if(osLocks[i].inUse && osLocks[i].lock->isHeldByCurrentThread()) {
+      osLocks[i].lock->Release();
+      osLocks[i].usageCounter--;
+      if(osLocks[i].toBeDestroyed && osLocks[i].usageCounter == 0) {
+	DestroyKernelLock(i);
+      }
+    }
+  }
+  KernelLockTableLock->Release();
+}
 
-  //limit size of lock name
-  if((size < 1) || (size > max_chars)) {
-    DEBUG('q',"TOO MANY CHARS\n");
-    return -1;
+void FreeKernelObjects(AddrSpace *space) {
+  // Destroy the locks and conditions a process still owns, when its
+  // address space goes away
+  int i;
+
+  KernelCondTableLock->Acquire();
+  for(i = 0; i < numOsConds && space->condsOwned > 0; i++) {
+    if(osConds[i].inUse && osConds[i].as == space) {
+      DestroyKernelCond(i);
+    }
   }
-  
+  KernelCondTableLock->Release();
+
+  KernelLockTableLock->Acquire();
+  for(i = 0; i < numOsLocks && space->locksOwned > 0; i++) {
+    if(osLocks[i].inUse && osLocks[i].as == space) {
+      DestroyKernelLock(i);
+    }
+  }
+  KernelLockTableLock->Release();
+}
+
+#ifdef NETWORK
+int NetworkRequest(Message *request, int toMachine, int box, bool wantReply,
+		   Message *replyOut = NULL) {
+  // Send a request from the current thread's mailbox to (toMachine, box)
+  // and, if wantReply, wait there for the answer. Returns the answer's
+  // arg1, which is the id or value asked for, or negative on an error.
+  // The whole answer is copied to replyOut, if there is one.
+  PacketHeader inPktHdr;
+  MailHeader inMailHdr;
+  Message reply;
+
+  request->seq = NextMessageSeq();
+  SendMessage(request, toMachine, box, currentThread->getMailbox());
+  if(!wantReply) {
+    return 0;
+  }
+  ReceiveMessage(currentThread->getMailbox(), &reply, &inPktHdr, &inMailHdr);
+  if(reply.seq != request->seq) {
+    DEBUG('n',"Got the answer to request %d waiting for %d\n", reply.seq, request->seq);
+  }
+  if(replyOut != NULL) {
+    *replyOut = reply;
+  }
+  return reply.arg1;
+}
+
+int NetThreadRequest(Message *request, bool wantReply, Message *replyOut = NULL) {
+  // Send a request to this process's network thread
+  return NetworkRequest(request, postOffice->getNetAddr(),
+			currentThread->space->getMailbox(), wantReply, replyOut);
+}
+#endif
+
+int CreateLock_Syscall(int vaddr) {
+#ifndef NETWORK
+  // Return a handle to a new lock in the kernel lock table
+  int size = 16;
   int addressSpaceSize = currentThread->space->NumPages() * PageSize;
-  //in the clear to create the lock
-  char *lockName = new char[size+1];
-  lockName[size] = '\0';
+  int slot, handle;
 
   //make sure we aren't creating any part of the lock outside the alloted space
   if(vaddr < 0 || (vaddr+size) >= addressSpaceSize) {
@@ -284,107 +557,36 @@ int CreateLock_Syscall(int vaddr) {
     return -1;
   }
 
-  // Make sure the table is not full 
-  if(nextLockIndex >= MAX_LOCKS) {
+  char *lockName = new char[size+1];
+  copyin(vaddr,size,lockName);
+  lockName[size] = '\0';
+
+  KernelLockTableLock->Acquire();
+  slot = AllocSlot(osLocks, numOsLocks, freeOsLocks);
+  if(slot == -1) {
     //The table is full of locks 
     KernelLockTableLock->Release();
     DEBUG('q',"LOCK TABLE FULL\n");
+    delete[] lockName;
     return -1;
   }
-
-  copyin(vaddr,size+1,lockName);
-
-  //initialize important vars
-  osLocks[nextLockIndex].lock = new Lock(lockName);
-  osLocks[nextLockIndex].as = currentThread->space;
-  //initialize lock to not in use
-  osLocks[nextLockIndex].usageCounter = 0;
-  //no one wants to destroy the lock right now
-  osLocks[nextLockIndex].toBeDestroyed = FALSE;
-  //report number of locks to user first...
-  //increment number of locks
-  int lockindex;
-  lockindex = nextLockIndex;
-  nextLockIndex++;
+  osLocks[slot].lock = new Lock(lockName);
+  currentThread->space->locksOwned++;
+  handle = SlotHandle(osLocks[slot].generation, slot);
   KernelLockTableLock->Release();
-  return lockindex;//-1 to get current lock index?
-  // this may prove to have some problems if
-  // we are context switched out before nextLockIndex is
-  // returned
+  return handle;
 #else
-  
-  stringstream ss;
-
-  PacketHeader outPktHdr, inPktHdr;
-  MailHeader outMailHdr, inMailHdr;
-  char buffer[MaxMailSize];
 
+  Message request(MSG_CREATE_LOCK);
   int size = 16;
-  char *lockName = new char[size];
+  char lockName[16+1];
   copyin(vaddr,size,lockName);
+  lockName[size] = '\0';
+  strncpy(request.name, lockName, MessageNameSize);
+  request.name[MessageNameSize] = '\0';
 
-  //cout<<"lock name: "<<lockName<<endl;
-  string lockNameStr = "L ";
-  lockNameStr.append(lockName);
-  //cout<<"lockNameStr: "<<lockNameStr<<endl;
-
-  strcpy(buffer, lockNameStr.c_str());
-
-  //ss.clear();
-  //ss<<lockNameStr;
-  //ss<<"L "<<lockNameStr;
-  //ss>>buffer;
-  
-  //cout<<"buffer: "<<buffer<<endl;
-
-  outPktHdr.to = postOffice->getNetAddr();
-  /*  outMailHdr.to = 0;*/
-  outMailHdr.to = currentThread->space->getMailbox();
-  //printf("mailbox # (network thread): %d\n",currentThread->space->getMailbox());
-  //printf("mailbox # (current thread): %d\n",currentThread->getMailbox());
-  //printf("machine # (default): %d\n",outPktHdr.to);
-
-  outMailHdr.from = currentThread->getMailbox();
-  outMailHdr.length = strlen(buffer)+1;
-
-  bool success = postOffice->Send(outPktHdr, outMailHdr, buffer);
-
-  if(!success) {
-    //printf("The postOffice Send failed.\n");
-    interrupt->Halt();
-  }
-
-  postOffice->Receive(currentThread->getMailbox(), &inPktHdr, &inMailHdr, buffer);
-  //printf("Got \"%s\" from %d, box %d\n",buffer,inPktHdr.from,inMailHdr.from);
-  fflush(stdout);
-  
-  ss.clear();
-  ss.str(buffer);
-  int lockID_rec;
-  ss>>lockID_rec;
-
-
-  //no one needs the token, send to the next group member
-  //TODO - send the next group member (via the network thread)
-	
-  outPktHdr.to = postOffice->getNetAddr();
-  outMailHdr.to = currentThread->space->getMailbox(); //send to network thread
-
-  ss.clear();
-  ss<<"T "<<lockID_rec;
-  ss>>buffer;
-
-  outMailHdr.length = strlen(buffer) + 1;
-  success = postOffice->Send(outPktHdr, outMailHdr, buffer);
-  if(!success) {
-    //printf("The post office send failed.\n");
-    interrupt->Halt();
-  }
-
-  return lockID_rec; //will be -1 if lock table is full
-  
-  
-  
+  //my network thread starts a new lock's token around the group
+  return NetThreadRequest(&request, TRUE); //will be negative if the token table is full
 
 #endif
 
@@ -392,76 +594,28 @@ int CreateLock_Syscall(int vaddr) {
 
 void DestroyLock_Syscall(int value) {
 #ifndef NETWORK
-  // Delete from kernel structure array the lock object at position index
-  int index = value;
-  // Delete from kernel structure array the lock object at position index
-
-  //First, acquire kernallocktablelock
+  // Delete from the kernel lock table the lock with handle value. If
+  // it is in use, it is destroyed when the last user releases it.
   KernelLockTableLock->Acquire();
-  
-  //if the lock is in use, mark for destruction
-  if(osLocks[index].usageCounter > 0){
-    DEBUG('q',"CANNOT DESTROY LOCK IN USE\n");
-    osLocks[index].toBeDestroyed = TRUE;
-    KernelLockTableLock->Release();
-    return;
-  }
-  
-  //if the lock is already destined to be destroyed, return
-  if((osLocks[index].usageCounter == 0) || (osLocks[index].toBeDestroyed == TRUE)){
-    //destroy lock
-    osLocks[index].toBeDestroyed = TRUE;
-    //effectively destroy lock
-    osLocks[index].lock = NULL;
-    DEBUG('q',"DESTROYING LOCK\n");
-    KernelLockTableLock->Release();
-    return;
-  }
-
-#else
+  KernelLock *entry = LookupSlot(osLocks, numOsLocks, value);
 
-  stringstream ss;
-
-  PacketHeader outPktHdr, inPktHdr;
-  MailHeader outMailHdr, inMailHdr;
-  char buffer[MaxMailSize];
-
-  //int size = 16;
-  //char *lockName = new char[size];
-  //copyin(vaddr,size,lockName);
-
-  //ss.clear();
-  //ss<<"D "<<lockName;
-  //ss>>buffer;
-
-  sprintf(buffer, "D %d", value);
-  
-  outPktHdr.to = 0;
-  outMailHdr.to = 0;
-  outMailHdr.from = 1;
-  outMailHdr.length = strlen(buffer)+1;
-
-  bool success = postOffice->Send(outPktHdr, outMailHdr, buffer);
-
-  if(!success) {
-    printf("The postOffice Send failed.\n");
-    interrupt->Halt();
+  if(entry != NULL) {
+    if(entry->usageCounter > 0) {
+      DEBUG('q',"CANNOT DESTROY LOCK IN USE\n");
+      entry->toBeDestroyed = TRUE;
+    } else {
+      DestroyKernelLock(entry - osLocks);
+    }
   }
+  KernelLockTableLock->Release();
 
-  postOffice->Receive(1, &inPktHdr, &inMailHdr, buffer);
-  //printf("Got \"%d\" from %d, box %d\n",buffer,inPktHdr.from,inPktHdr.from);
-  fflush(stdout);
+#else
 
-  ss.str(buffer);
-  int lockID_rec;
-  ss>>lockID_rec;
+  Message request(MSG_DESTROY_LOCK, value);
 
-  if(lockID_rec < 0) {
+  if(NetworkRequest(&request, ServerForId(value), 0, TRUE) < 0) {
     //there was an error destroying the lock
     DEBUG('q',"Error destroying lock\n");
-  } else {
-    //lock destroyed successfully (received confirmation from server)
-    //do nothing
   }
 
 #endif
@@ -470,94 +624,35 @@ void DestroyLock_Syscall(int value) {
 
 void Acquire_Syscall(int index) {
 #ifndef NETWORK
+  DEBUG('q',"lock handle is: %d\n",index);
+  // make sure the handle names a lock of ours
   KernelLockTableLock->Acquire();
-  int value = index; // this is the value read by machine->readregister(4)
-  DEBUG('a',"ACQUIRING LOCK\n\n\n\n\n");
-  DEBUG('q',"lock index is: %d\n",index);
-  // perform series of checks on the lock
-  // to make sure user program is not doing
-  // anything crazy
-
-  //make sure the lock exists
-  if(value < 0 || value >= nextLockIndex) {
-    // This is a bad value
-    DEBUG('q',"BAD VALUE\n");
-    return;
-  }
-
-  KernelLock curLock = osLocks[index];
-  if(curLock.lock == NULL) {
-    // The lock has been destroyed 
-    DEBUG('q',"LOCK HAS BEEN DESTROYED\n");
-    return;
-  }
-  // The lock has not been destroyed
-  
-  if(curLock.as != currentThread->space) {
-    // this lock belongs to a different process
-    // since the address space of the lock does not match the 
-    // current thread's address space
-    DEBUG('q',"%s : Acquire Syscall: LOCK %d BELONGS TO DIFFERENT PROCESS\n", currentThread->getName(), index);
+  KernelLock *entry = LookupSlot(osLocks, numOsLocks, index);
+  if(entry == NULL) {
     KernelLockTableLock->Release();
     return;
   }
-  //ensure that lock isn't destroyed while in use
-  curLock.usageCounter++; 
+  //ensure that lock isn't destroyed while in use; Acquire does nothing
+  //if we already hold it, and neither must the count
+  if(!entry->lock->isHeldByCurrentThread()) {
+    entry->usageCounter++; 
+  }
+  Lock *lock = entry->lock;
   DEBUG('q',"%s is ACQUIRING LOCK\n", currentThread->getName());
-  //has to go above acquire to avoid deadlock
+  //has to go above acquire to avoid deadlock; the table may grow
+  //while we wait, so only the lock itself is kept
   KernelLockTableLock->Release();
-    // FINALLY...Acquire the lock
-  curLock.lock->Acquire();
+  // FINALLY...Acquire the lock
+  lock->Acquire();
 
 #else
 
-  stringstream ss;
-
-  PacketHeader outPktHdr, inPktHdr;
-  MailHeader outMailHdr, inMailHdr;
-  char buffer[MaxMailSize];
-
-  //int size = 16;
-  //char *lockName = new char[size];
-  //copyin(vaddr,size,lockName);
-
-  //ss.clear();
-  //ss<<"D "<<lockName;
-  //ss>>buffer;
-
-  sprintf(buffer, "A %d", index);
-  
-  outPktHdr.to = postOffice->getNetAddr();
-  outMailHdr.to = currentThread->space->getMailbox();
-  outMailHdr.from = currentThread->getMailbox();
-  //outPktHdr.to = 0;
-  //outMailHdr.to = 0;
-  //outMailHdr.from = 1;
-  outMailHdr.length = strlen(buffer)+1;
-
-  bool success = postOffice->Send(outPktHdr, outMailHdr, buffer);
-
-  if(!success) {
-    printf("The postOffice Send failed.\n");
-    interrupt->Halt();
-  }
+  // the answer comes once my network thread has the token
+  Message request(MSG_ACQUIRE, index);
 
-  postOffice->Receive(currentThread->getMailbox(), &inPktHdr, &inMailHdr, buffer);
-  //printf("Got \"%d\" from %d, box %d\n",buffer,inPktHdr.from,inPktHdr.from);
-  fflush(stdout);
-
-  ss.str(buffer);
-  int lockID_rec;
-  ss>>lockID_rec;
-
-  //printf("ACQUIRE: Server Response:%d.\n",lockID_rec);
-
-  if(lockID_rec < 0) {
+  if(NetThreadRequest(&request, TRUE) < 0) {
     //there was an error acquiring the lock
     DEBUG('q',"Error acquiring lock\n");
-  } else {
-    //lock acquired successfully (received confirmation from server)
-    //do nothing
   }
 
 #endif
@@ -566,81 +661,32 @@ void Acquire_Syscall(int index) {
 
 void Release_Syscall(int index) {
 #ifndef NETWORK
-  //NOTE: I just made this the same checks as Acquire for now....
   KernelLockTableLock->Acquire();
-  int value = index;
-  //make sure the lock exists
-  if(value < 0 || value >= nextLockIndex) {
-    // This is a bad value
-    DEBUG('q',"BAD VALUE\n");
-    return;
-  }
-  KernelLock curLock = osLocks[index];
-  if(curLock.lock == NULL) {
-    // The lock has been destroyed 
-    DEBUG('q',"LOCK HAS BEEN DESTROYED\n");
+  KernelLock *entry = LookupSlot(osLocks, numOsLocks, index);
+  if(entry == NULL) {
+    KernelLockTableLock->Release();
     return;
   }
-  
-  if(curLock.as != currentThread->space) {
-    // this lock belongs to a different process
-    // since the address space of the lock does not match the 
-    // current thread's address space    
-    DEBUG('q',"Release Syscall: LOCK BELONGS TO DIFFERENT PROCESS\n");
+  if(!entry->lock->isHeldByCurrentThread()) {
+    DEBUG('q',"Release Syscall: LOCK %d NOT HELD\n", index);
     KernelLockTableLock->Release();
     return;
   }
-  //ensure that lock isn't destroyed while in use
   DEBUG('q',"RELEASING LOCK\n");
-
-  //has to go above acquire to avoid deadlock
+  // Release doesn't block, so the table lock can be held across it
+  entry->lock->Release();
+  entry->usageCounter--;
+  if(entry->toBeDestroyed && entry->usageCounter == 0) {
+    DestroyKernelLock(entry - osLocks);
+  }
   KernelLockTableLock->Release();
-    // FINALLY...Release the lock
-  curLock.lock->Release();
-  curLock.usageCounter--;
 
 #else
-  
-  stringstream ss;
-
-  PacketHeader outPktHdr, inPktHdr;
-  MailHeader outMailHdr, inMailHdr;
-  char buffer[MaxMailSize];
-
 
-  sprintf(buffer, "R %d", index);
-  
-  //outPktHdr.to = 0;
-  //outMailHdr.to = 0;
-  outPktHdr.to = postOffice->getNetAddr();
-  outMailHdr.to = currentThread->space->getMailbox();
-  outMailHdr.from = currentThread->getMailbox();
-  outMailHdr.length = strlen(buffer)+1;
-
-  bool success = postOffice->Send(outPktHdr, outMailHdr, buffer);
+  // my network thread passes the token on; there is no answer
+  Message request(MSG_RELEASE, index);
 
-  if(!success) {
-    printf("The postOffice Send failed.\n");
-    interrupt->Halt();
-  }
-
-  /*
-  postOffice->Receive(currentThread->getMailbox(), &inPktHdr, &inMailHdr, buffer);
-  printf("Got \"%d\" from %d, box %d\n",buffer,inPktHdr.from,inPktHdr.from);
-  fflush(stdout);
-
-  ss.str(buffer);
-  int lockID_rec;
-  ss>>lockID_rec;
-
-  if(lockID_rec < 0) {
-    //there was an error releasing the lock
-    DEBUG('q',"Error releasing lock\n");
-  } else {
-    //lock released successfully (received confirmation from server)
-    //do nothing
-  }
-  */
+  NetThreadRequest(&request, FALSE);
 
 #endif
 
@@ -648,96 +694,29 @@ void Release_Syscall(int index) {
 
 int CreateCondition_Syscall() {
 #ifndef NETWORK
-  KernelCondTableLock->Acquire();
-  //copied from CreateLock, IS OK???
-  // Return position in kernel structure array
-  int size = 16;
-  int max_chars = 20;
+  // Return a handle to a new condition in the kernel condition table
+  int slot, handle;
 
-  //limit size of condition name
-  if((size < 1) || (size > max_chars)) {
-    DEBUG('q',"TOO MANY CHARS\n");
-    return -1;
-  }
-  
-  int addressSpaceSize = currentThread->space->NumPages() * PageSize;
-  //in the clear to create the condition
-  char *condName = new char[size+1];
-  condName[size] = '\0';
-
-  //NO creating any part of the condition outside the alloted space
-  /*if(vaddr < 0 || (vaddr+size) >= addressSpaceSize) {
-    DEBUG('q',"OUT OF BOUNDS\n");
-    return -1;
-    }*/
-
-  // Make sure the table is not full 
-  if(nextCondIndex >= MAX_CONDS) {
-    //The table is full of locks 
+  KernelCondTableLock->Acquire();
+  slot = AllocSlot(osConds, numOsConds, freeOsConds);
+  if(slot == -1) {
+    //The table is full of conditions
     KernelCondTableLock->Release();
     DEBUG('q',"COND TABLE FULL\n");
     return -1;
   }
-
-  /*copyin(vaddr,size+1,condName);*/
-
-  //initialize important vars
-  osConds[nextCondIndex].condition = new Condition("");
-  osConds[nextCondIndex].as = currentThread->space;
-  //initialize condition to not in use
-  osConds[nextCondIndex].usageCounter = 0;
-  //no one wants to destroy the lock right now
-  osConds[nextCondIndex].toBeDestroyed = FALSE;
-  //report number of locks to user first...
-  //increment number of locks
-  int condindex = nextCondIndex;
-  nextCondIndex++;
+  osConds[slot].condition = new Condition("");
+  currentThread->space->condsOwned++;
+  handle = SlotHandle(osConds[slot].generation, slot);
   KernelCondTableLock->Release();
-  return condindex;//-1 to get current condition index?
-  // this may prove to have some problems if
-  // we are context switched out before nextCondIndex is
-  // returned 
+  return handle;
 
 #else
 
-  stringstream ss;
+  Message request(MSG_CREATE_COND);
 
-  PacketHeader outPktHdr, inPktHdr;
-  MailHeader outMailHdr, inMailHdr;
-  char buffer[MaxMailSize];
-
-  //int size = 16;
-  //char *cvName = new char[size];
-  //copyin(vaddr,size,cvName);
-
-  char *cvName = " ";
-
-  ss.clear();
-  ss<<"C "<<cvName;
-  ss>>buffer;
-  
-  outPktHdr.to = 0;
-  outMailHdr.to = 0;
-  outMailHdr.from = 1;
-  outMailHdr.length = strlen(buffer)+1;
-
-  bool success = postOffice->Send(outPktHdr, outMailHdr, buffer);
-
-  if(!success) {
-    printf("The postOffice Send failed.\n");
-    interrupt->Halt();
-  }
-
-  postOffice->Receive(currentThread->getMailbox(), &inPktHdr, &inMailHdr, buffer);
-  //printf("Got \"%s\" from %d, box %d\n",buffer,inPktHdr.from,inMailHdr.from);
-  fflush(stdout);
-  
-  ss.clear();
-  ss.str(buffer);
-  int condID_rec;
-  ss>>condID_rec;
-
-  return condID_rec; //will be -1 if condition table is full
+  //conditions have no name to place them by: spread them by machine
+  return NetworkRequest(&request, postOffice->getNetAddr() % numServers, 0, TRUE); //negative if the condition table is full
 
 #endif
 
@@ -745,29 +724,21 @@ int CreateCondition_Syscall() {
 
 void DestroyCondition_Syscall(int index) {
 #ifndef NETWORK
-  // Delete from kernel structure array the condition object at position index 
-// Delete from kernel structure array the condition object at position index 
-  //First, acquire kernalcondtablelock
+  // Delete from the kernel condition table the condition with handle
+  // index. If threads are waiting on it, it is destroyed when the last
+  // one wakes up.
   KernelCondTableLock->Acquire();
-  
-  //if the condition is in use, mark for destruction
-  if(osConds[index].usageCounter > 0){
-    DEBUG('q',"CANNOT DESTROY CONDITION IN USE\n");
-    osLocks[index].toBeDestroyed = TRUE;
-    KernelCondTableLock->Release();
-    return;
-  }
-  
-  //if the lock is already destined to be destroyed, return
-  if((osConds[index].usageCounter == 0) || (osConds[index].toBeDestroyed == TRUE)){
-    //destroy condition
-    osConds[index].toBeDestroyed = TRUE;
-    //effectively destroy lock
-    osConds[index].condition = NULL;
-    DEBUG('q',"DESTROYING CONDITION\n");
-    KernelCondTableLock->Release();
-    return;
+  KernelCond *entry = LookupSlot(osConds, numOsConds, index);
+
+  if(entry != NULL) {
+    if(entry->usageCounter > 0) {
+      DEBUG('q',"CANNOT DESTROY CONDITION IN USE\n");
+      entry->toBeDestroyed = TRUE;
+    } else {
+      DestroyKernelCond(entry - osConds);
+    }
   }
+  KernelCondTableLock->Release();
 #else
 
   // do nothing?
@@ -777,101 +748,46 @@ void DestroyCondition_Syscall(int index) {
 
 void Wait_Syscall(int index, int lock_id) {
 #ifndef NETWORK
+  // The condition table is always locked before the lock table
   KernelCondTableLock->Acquire();
-  //VALIDATE CONDITION
-  //make sure the condition exists
-  if(index < 0 || index >= nextCondIndex) {
-    // This is a bad value
-    DEBUG('q',"BAD VALUE\n");
-    return;
-  }
-  KernelCond curCond = osConds[index];
-  if(curCond.condition == NULL) {
-    // The condition has been destroyed 
-    DEBUG('q',"COND HAS BEEN DESTROYED\n");
-    return;
-  }
-  // The condition has not been destroyed
-  if(curCond.as != currentThread->space) {
-    // this condition belongs to a different process
-    // since the address space of the condition does not match the 
-    // current thread's address space
-    DEBUG('q',"%s : Wait Syscall: CONDITION %d BELONGS TO DIFFERENT PROCESS\n", currentThread->getName(), index);
+  KernelCond *curCond = LookupSlot(osConds, numOsConds, index);
+  if(curCond == NULL) {
     KernelCondTableLock->Release();
     return;
   }
-  //ensure that condition isn't destroyed while in use
-  curCond.usageCounter++; 
-  KernelCondTableLock->Release();
   KernelLockTableLock->Acquire();
-  //VALIDATE LOCK
-  //make sure the lock exists
-  if(lock_id < 0 || lock_id >= nextLockIndex) {
-    // This is a bad value
-    DEBUG('q',"BAD VALUE\n");
-    return;
-  }
-
-  KernelLock curLock = osLocks[lock_id];
-  if(curLock.lock == NULL) {
-    // The lock has been destroyed 
-    DEBUG('q',"LOCK HAS BEEN DESTROYED\n");
-    return;
-  }
-  // The lock has not been destroyed
-  
-  if(curLock.as != currentThread->space) {
-    // this lock belongs to a different process
-    // since the address space of the lock does not match the 
-    // current thread's address space
-    DEBUG('q',"%s : Wait Syscall: LOCK %d BELONGS TO DIFFERENT PROCESS\n", currentThread->getName(), lock_id);
+  KernelLock *curLock = LookupSlot(osLocks, numOsLocks, lock_id);
+  if(curLock == NULL) {
     KernelLockTableLock->Release();
+    KernelCondTableLock->Release();
     return;
   }
-  //ensure that lock isn't destroyed while in use
-  curLock.usageCounter++;
+  //ensure that condition isn't destroyed while in use
+  int slot = curCond - osConds;
+  curCond->usageCounter++;
+  Condition *condition = curCond->condition;
+  Lock *lock = curLock->lock;
   DEBUG('q',"CONDITION WAITING\n");
-  //has to go above acquire to avoid deadlock
   KernelLockTableLock->Release();
+  KernelCondTableLock->Release();
   // FINALLY...use wait on the lock
-  curCond.condition->Wait(curLock.lock);
+  condition->Wait(lock);
 
-#else
-
-  //stringstream ss;
-
-  PacketHeader outPktHdr, inPktHdr;
-  MailHeader outMailHdr, inMailHdr;
-  char buffer[MaxMailSize];
-
-  //int size = 16;
-  //char *cvName = new char[size];
-  //copyin(vaddr,size,cvName);
-
-  //ss.clear();
-  //ss<<"C "<<cvName;
-  //ss>>buffer;
-
-  sprintf(buffer, "W %d %d", index, lock_id);
-  
-  outPktHdr.to = 0;
-  outMailHdr.to = 0;
-  outMailHdr.from = 1;
-  outMailHdr.length = strlen(buffer)+1;
-
-  bool success = postOffice->Send(outPktHdr, outMailHdr, buffer);
-
-  if(!success) {
-    printf("The postOffice Send failed.\n");
-    interrupt->Halt();
+  // the table may have moved while we waited, so find it by slot
+  KernelCondTableLock->Acquire();
+  osConds[slot].usageCounter--;
+  if(osConds[slot].toBeDestroyed && osConds[slot].usageCounter == 0) {
+    DestroyKernelCond(slot);
   }
+  KernelCondTableLock->Release();
 
+#else
 
+  // the answer comes when we have been signalled and have the lock
+  // again
+  Message request(MSG_WAIT, index, lock_id);
 
-  postOffice->Receive(currentThread->getMailbox(), &inPktHdr, &inMailHdr, buffer);
-  //printf("Got \"%s\" from %d, box %d\n",buffer,inPktHdr.from,inMailHdr.from);
-  fflush(stdout);
- 
+  NetworkRequest(&request, ServerForId(index), 0, TRUE);
 
 #endif
 }
@@ -879,99 +795,32 @@ void Wait_Syscall(int index, int lock_id) {
 void Signal_Syscall(int index, int lock_id) {
 #ifndef NETWORK
   KernelCondTableLock->Acquire();
-  //VALIDATE CONDITION
-  //make sure the condition exists
-  if(index < 0 || index >= nextCondIndex) {
-    // This is a bad value
-    DEBUG('q',"BAD VALUE\n");
-    return;
-  }
-  KernelCond curCond = osConds[index];
-  if(curCond.condition == NULL) {
-    // The condition has been destroyed 
-    DEBUG('q',"COND HAS BEEN DESTROYED\n");
-    return;
-  }
-  // The condition has not been destroyed
-  if(curCond.as != currentThread->space) {
-    // this condition belongs to a different process
-    // since the address space of the condition does not match the 
-    // current thread's address space
-    DEBUG('q',"%s: Signal Syscall: CONDITION %d BELONGS TO DIFFERENT PROCESS\n", currentThread->getName(), index);
+  KernelCond *curCond = LookupSlot(osConds, numOsConds, index);
+  if(curCond == NULL) {
     KernelCondTableLock->Release();
     return;
   }
-  //ensure that condition isn't destroyed while in use
-  curCond.usageCounter--; 
-  KernelCondTableLock->Release();
   KernelLockTableLock->Acquire();
-  //VALIDATE LOCK
-  //make sure the lock exists
-  if(lock_id < 0 || lock_id >= nextLockIndex) {
-    // This is a bad value
-    DEBUG('q',"BAD VALUE\n");
-    return;
-  }
-
-  KernelLock curLock = osLocks[lock_id];
-  if(curLock.lock == NULL) {
-    // The lock has been destroyed 
-    DEBUG('q',"LOCK HAS BEEN DESTROYED\n");
-    return;
-  }
-  // The lock has not been destroyed
-  
-  if(curLock.as != currentThread->space) {
-    // this lock belongs to a different process
-    // since the address space of the lock does not match the 
-    // current thread's address space
-    DEBUG('q',"%s: Signal Syscall: LOCK %d BELONGS TO DIFFERENT PROCESS\n", currentThread->getName(), index);
+  KernelLock *curLock = LookupSlot(osLocks, numOsLocks, lock_id);
+  if(curLock == NULL) {
     KernelLockTableLock->Release();
+    KernelCondTableLock->Release();
     return;
   }
-  //ensure that lock isn't destroyed while in use
-  curLock.usageCounter--;
   DEBUG('q',"CONDITION SIGNAL\n");
-  //has to go above acquire to avoid deadlock
+  // the woken threads account for themselves when they return from
+  // Wait, and neither table entry can go away while we hold the
+  // table locks
+  curCond->condition->Signal(curLock->lock);
   KernelLockTableLock->Release();
-  // FINALLY...use signal on the lock
-  curCond.condition->Signal(curLock.lock);
+  KernelCondTableLock->Release();
 
 #else
 
-  //stringstream ss;
-
-  PacketHeader outPktHdr, inPktHdr;
-  MailHeader outMailHdr, inMailHdr;
-  char buffer[MaxMailSize];
-
-  //int size = 16;
-  //char *cvName = new char[size];
-  //copyin(vaddr,size,cvName);
-
-  //ss.clear();
-  //ss<<"C "<<cvName;
-  //ss>>buffer;
-
-  sprintf(buffer, "S %d %d", index, lock_id);
-  
-  outPktHdr.to = 0;
-  outMailHdr.to = 0;
-  outMailHdr.from = 1;
-  outMailHdr.length = strlen(buffer)+1;
-
-  bool success = postOffice->Send(outPktHdr, outMailHdr, buffer);
-
-  if(!success) {
-    printf("The postOffice Send failed.\n");
-    interrupt->Halt();
-  }
-
   // Signal does not expect any response message
+  Message request(MSG_SIGNAL, index, lock_id);
 
-  //postOffice->Receive(1, &inPktHdr, &inMailHdr, buffer);
-  //printf("Got \"%s\" from %d, box %d\n",buffer,inPktHdr.from,inMailHdr.from);
-  //fflush(stdout);
+  NetworkRequest(&request, ServerForId(index), 0, FALSE);
 
 #endif
 
@@ -980,105 +829,32 @@ void Signal_Syscall(int index, int lock_id) {
 void Broadcast_Syscall(int index, int lock_id) {
 #ifndef NETWORK
   KernelCondTableLock->Acquire();
-  //VALIDATE CONDITION
-  //make sure the condition exists
-  if(index < 0 || index >= nextCondIndex) {
-    // This is a bad value
-    DEBUG('q',"BAD VALUE\n");
-    return;
-  }
-  KernelCond curCond = osConds[index];
-  if(curCond.condition == NULL) {
-    // The condition has been destroyed 
-    DEBUG('q',"COND HAS BEEN DESTROYED\n");
-    return;
-  }
-  // The condition has not been destroyed
-  if(curCond.as != currentThread->space) {
-    // this condition belongs to a different process
-    // since the address space of the condition does not match the 
-    // current thread's address space
-    DEBUG('q',"Broadcast Syscall: CONDITION BELONGS TO DIFFERENT PROCESS\n");
+  KernelCond *curCond = LookupSlot(osConds, numOsConds, index);
+  if(curCond == NULL) {
     KernelCondTableLock->Release();
     return;
   }
-  //ensure that condition isn't destroyed while in use
-  int temp = curCond.usageCounter;
-  curCond.usageCounter--; 
-  KernelCondTableLock->Release();
   KernelLockTableLock->Acquire();
-  //VALIDATE LOCK
-  //make sure the lock exists
-  if(lock_id < 0 || lock_id >= nextLockIndex) {
-    // This is a bad value
-    DEBUG('q',"BAD VALUE\n");
-    return;
-  }
-
-  KernelLock curLock = osLocks[lock_id];
-  if(curLock.lock == NULL) {
-    // The lock has been destroyed 
-    DEBUG('q',"LOCK HAS BEEN DESTROYED\n");
-    return;
-  }
-  // The lock has not been destroyed
-  
-  if(curLock.as != currentThread->space) {
-    // this lock belongs to a different process
-    // since the address space of the lock does not match the 
-    // current thread's address space
-    DEBUG('q',"Broadcast Syscall: LOCK %d BELONGS TO DIFFERENT PROCESS\n",lock_id);
+  KernelLock *curLock = LookupSlot(osLocks, numOsLocks, lock_id);
+  if(curLock == NULL) {
     KernelLockTableLock->Release();
+    KernelCondTableLock->Release();
     return;
   }
-  //ensure that lock isn't destroyed while in use
-  if(curLock.usageCounter - temp >= 0){
-    curLock.usageCounter = curLock.usageCounter - temp;
-  }else{
-    curLock.usageCounter = 0;
-  }
   DEBUG('q',"CONDITION BROADCAST\n");
-  //has to go above acquire to avoid deadlock
+  // the woken threads account for themselves when they return from
+  // Wait, and neither table entry can go away while we hold the
+  // table locks
+  curCond->condition->Broadcast(curLock->lock);
   KernelLockTableLock->Release();
-  // FINALLY...use broadcast on the lock
-  curCond.condition->Broadcast(curLock.lock);
-
+  KernelCondTableLock->Release();
 
 #else
 
-  //stringstream ss;
-
-  PacketHeader outPktHdr, inPktHdr;
-  MailHeader outMailHdr, inMailHdr;
-  char buffer[MaxMailSize];
-
-  //int size = 16;
-  //char *cvName = new char[size];
-  //copyin(vaddr,size,cvName);
-
-  //ss.clear();
-  //ss<<"C "<<cvName;
-  //ss>>buffer;
-
-  sprintf(buffer, "B %d %d", index, lock_id);
-  
-  outPktHdr.to = 0;
-  outMailHdr.to = 0;
-  outMailHdr.from = 1;
-  outMailHdr.length = strlen(buffer)+1;
-
-  bool success = postOffice->Send(outPktHdr, outMailHdr, buffer);
-
-  if(!success) {
-    printf("The postOffice Send failed.\n");
-    interrupt->Halt();
-  }
-
   // Broadcast does not expect any response message
+  Message request(MSG_BROADCAST, index, lock_id);
 
-  //postOffice->Receive(1, &inPktHdr, &inMailHdr, buffer);
-  //printf("Got \"%s\" from %d, box %d\n",buffer,inPktHdr.from,inMailHdr.from);
-  //fflush(stdout);
+  NetworkRequest(&request, ServerForId(index), 0, FALSE);
 
 #endif
 
@@ -1118,209 +894,297 @@ void Exit_Syscall(int status) {
 }
 
 void Register_Syscall() {
-  stringstream ss;
-
-  PacketHeader outPktHdr, inPktHdr;
-  MailHeader outMailHdr, inMailHdr;
-  char buffer[MaxMailSize];
-  //char *data = "J";
-
-  ss.clear();
-  ss << "J";
-  ss >> buffer;
-
-  outPktHdr.to = postOffice->getNetAddr();
-  /* */
-  outMailHdr.to = currentThread->space->getMailbox();
-  outMailHdr.from = currentThread->getMailbox();
-  outMailHdr.length = strlen(buffer)+1;
-  //printf("Register syscall: mb: %d \n",currentThread->getMailbox());
-  bool success = postOffice->Send(outPktHdr, outMailHdr, buffer);
-  if(!success) {
-    printf("The post office send failed.\n");
-    interrupt->Halt();
-  }
-  
-  postOffice->Receive(currentThread->getMailbox(), &inPktHdr, &inMailHdr, buffer);
-  //printf("Got \"%s\" from %d, box %d\n",buffer,inPktHdr.from,inMailHdr.from);
+#ifdef NETWORK
+  // Join the group through my network thread, and wait until everyone
+  // has joined
+  Message request(MSG_REGISTER);
 
-  fflush(stdout);
-  /*
-  ss.clear();
-  ss.str(buffer);
-
-  string currentClient;
-  int numClients = 0;
-  //Member clients[1000];
-  printf("Member List Received:\n");
-  while( getline(ss, currentClient, ' ')) {
-    
-    int firstCommaPos = currentClient.find_first_of(",");
-    //cout<<"firstCommaPos:"<<firstCommaPos<<endl;
-    //int lastPeriodPos = currentClient.find_last_of(".");
-    string machineNumStr = currentClient.substr(0,firstCommaPos);
-    string mailboxNumStr = currentClient.substr(firstCommaPos+1);
-    //cout<<"machine num: "<<machineNumStr<<" mailbox num: "<<mailboxNumStr<<endl;
-    int machineNum = atoi(machineNumStr.c_str());
-    int mailboxNum = atoi(mailboxNumStr.c_str());
-    clients[numClients].machineNum = machineNum;
-    clients[numClients].mailboxNum = mailboxNum;
-    numClients++;
-    printf("   Machine: %d, Mailbox: %d\n", machineNum, mailboxNum);
-    //cout<<"machine num: "<<machineNum<<" mailbox num: "<<mailboxNum<<endl;
-  }
-  printf("There are %d clients (including myself)\n",numClients);
-  */
+  NetThreadRequest(&request, TRUE);
+#endif
 }
 
 /* Returns the value of the monitor variable at the index specified */
 int GetMV_Syscall(int index) {
-  int value;
-  stringstream ss;
-
-  PacketHeader outPktHdr, inPktHdr;
-  MailHeader outMailHdr, inMailHdr;
-  char buffer[MaxMailSize];
-  //char *data = "J";
-
-  //ss.clear();
-  //ss << "GMV";
-  //ss >> buffer;
-
-  sprintf(buffer, "GMV %d", index);
-
-  /* Get the machine id */
-  outPktHdr.to = postOffice->getNetAddr();
-  /* Set the to field to the mailbox of the mailbox */
-  outMailHdr.to = currentThread->space->getMailbox();
-  /* Set the from field to this thread's current mailbox */
-  outMailHdr.from = currentThread->getMailbox();
-
-  outMailHdr.length = strlen(buffer)+1;
-
-  bool success = postOffice->Send(outPktHdr, outMailHdr, buffer);
-  if(!success) {
-    printf("The post office send failed.\n");
-    interrupt->Halt();
-  }
-  
-  /* Wait for networking thread to send back the mv */
-  postOffice->Receive(currentThread->getMailbox(), &inPktHdr, &inMailHdr, buffer);
-  //printf("Got \"%s\" from %d, box %d\n",buffer,inPktHdr.from,inMailHdr.from);
-
-  ss.clear();
-  ss.str(buffer);
-  int mv;
-  ss>>mv;
-
-  return mv;
+#ifdef NETWORK
+  /* The network thread gets the MV from the server */
+  Message request(MSG_GET_MV, index);
 
+  return NetThreadRequest(&request, TRUE);
+#else
+  return -1;
+#endif
 }
 
 /* This syscall will talk to the networking thread and tell it to tell the server */
 /* to change a value of a monitor variable */
 void SetMV_Syscall(int index, int value) {
-  
+#ifdef NETWORK
   /* Send a message to the network thread, giving it the index value of the MV, as well as the */
   /* value that it is supposed to be set to */
+  Message request(MSG_SET_MV, index, value);
 
-  stringstream ss;
-
-  PacketHeader outPktHdr, inPktHdr;
-  MailHeader outMailHdr, inMailHdr;
-  char buffer[MaxMailSize];
-  //char *data = "J";
-
-  //ss.clear();
-  //ss << "SMV";
-  //ss >> buffer;
-
-  sprintf(buffer, "SMV %d %d", index, value);
-
-  outPktHdr.to = postOffice->getNetAddr();
-  /* */
-  outMailHdr.to = currentThread->space->getMailbox();
-  outMailHdr.from = currentThread->getMailbox();
-  outMailHdr.length = strlen(buffer)+1;
+  NetThreadRequest(&request, FALSE);
+#endif
+}
 
-  bool success = postOffice->Send(outPktHdr, outMailHdr, buffer);
-  if(!success) {
-    printf("The post office send failed.\n");
-    interrupt->Halt();
+int MVBatch_Syscall(bool get, unsigned int idsAddr, unsigned int valuesAddr, int count) {
+  // Get (if get is true) or set the "count" MVs whose
+  // ids are in the user array at idsAddr, to or from the values in the
+  // array at valuesAddr. The network thread sends them to the server
+  // MaxBatchItems at a time. Returns count, or -1 on a bad argument.
+#ifdef NETWORK
+  unsigned int size = currentThread->space->NumPages() * PageSize;
+  int op = get ? MSG_GET_MV : MSG_SET_MV;
+  int ids[MaxBatchItems];
+  int values[MaxBatchItems];
+  Message request, reply;
+  int done, n, i;
+
+  if(count < 0 || (unsigned int)count > size / sizeof(int) ||
+     idsAddr > size - count * sizeof(int) ||
+     valuesAddr > size - count * sizeof(int)) {
+    DEBUG('a',"Bad array passed to GetMVs/SetMVs\n");
+    return -1;
   }
-  
-  //postOffice->Receive(currentThread->getMailbox(), &inPktHdr, &inMailHdr, buffer);
-  //printf("Got \"%s\" from %d, box %d\n",buffer,inPktHdr.from,inMailHdr.from);
 
-  //fflush(stdout);
+  for(done = 0; done < count; done += n) {
+    n = count - done;
+    if(n > MaxBatchItems) {
+      n = MaxBatchItems;
+    }
+    copyin(idsAddr + done * sizeof(int), n * sizeof(int), (char *)ids);
+    if(op == MSG_SET_MV) {
+      copyin(valuesAddr + done * sizeof(int), n * sizeof(int), (char *)values);
+    }
 
+    request = Message(MSG_BATCH, n);
+    request.numItems = n;
+    for(i = 0; i < n; i++) {
+      request.itemOp[i] = op;
+      request.itemArg1[i] = WordToHost(ids[i]);
+      request.itemArg2[i] = (op == MSG_SET_MV) ? WordToHost(values[i]) : 0;
+    }
+    NetThreadRequest(&request, TRUE, &reply);
 
+    if(op == MSG_GET_MV) {
+      for(i = 0; i < n; i++) {
+	values[i] = WordToHost(i < reply.numItems ? reply.itemArg1[i] : MessageError);
+      }
+      copyout(valuesAddr + done * sizeof(int), n * sizeof(int), (char *)values);
+    }
+  }
+  return count;
+#else
+  return -1;
+#endif
 }
 
 int CreateMV_Syscall(unsigned int vaddr) {
-  stringstream ss;
-
-  PacketHeader outPktHdr, inPktHdr;
-  MailHeader outMailHdr, inMailHdr;
-  char buffer[MaxMailSize];
-
+#ifdef NETWORK
+  Message request(MSG_CREATE_MV);
   int size = 16;
-  char *lockName = new char[size];
-  copyin(vaddr,size,lockName);
+  char mvName[16+1];
+  copyin(vaddr,size,mvName);
+  mvName[size] = '\0';
+  strncpy(request.name, mvName, MessageNameSize);
+  request.name[MessageNameSize] = '\0';
+
+  return NetThreadRequest(&request, TRUE); //will be negative if the MV table is full
+#else
+  return -1;
+#endif
+}
 
-  //cout<<"lock name: "<<lockName<<endl;
-  string lockNameStr = "CMV ";
-  lockNameStr.append(lockName);
-  //cout<<"lockNameStr: "<<lockNameStr<<endl;
+#ifdef NETWORK
+void DeferNetRequest(List *deferred, NetRequest *request, bool first) {
+  // Put a request aside for the network thread to handle later; first
+  // means it has already waited longer than the ones in the list
+  if(first) {
+    deferred->Prepend((void *)request);
+  } else {
+    deferred->Append((void *)request);
+  }
+}
 
-  strcpy(buffer, lockNameStr.c_str());
+bool NextNetRequest(int myMailboxNum, List *deferred, NetRequest *request, bool wait) {
+  // Get the next request for the network thread: the oldest one put
+  // aside, or else the next one in its mailbox. If there is none and
+  // wait is false, return false.
+  PacketHeader inPktHdr;
+  MailHeader inMailHdr;
+  NetRequest *old = (NetRequest *)deferred->Remove();
+
+  if(old != NULL) {
+    *request = *old;
+    delete old;
+    return true;
+  }
+  if(wait) {
+    ReceiveMessage(myMailboxNum, &request->msg, &inPktHdr, &inMailHdr);
+  } else if(!TryReceiveMessage(myMailboxNum, &request->msg, &inPktHdr, &inMailHdr)) {
+    return false;
+  }
+  request->machineNum = inPktHdr.from;
+  request->mailboxNum = inMailHdr.from;
+  return true;
+}
 
-  //ss.clear();
-  //ss<<lockNameStr;
-  //ss<<"L "<<lockNameStr;
-  //ss>>buffer;
-  
-  //cout<<"buffer: "<<buffer<<endl;
+void AwaitServerReply(int myMailboxNum, Message *reply, List *deferred) {
+  // Wait for the server's answer to a request this network thread
+  // forwarded. Anything else that comes in meanwhile, tokens included,
+  // is put aside for the main loop.
+  PacketHeader inPktHdr;
+  MailHeader inMailHdr;
 
-  outPktHdr.to = postOffice->getNetAddr();
-  /*  outMailHdr.to = 0;*/
-  outMailHdr.to = currentThread->space->getMailbox();
-  //printf("mailbox # (network thread): %d\n",currentThread->space->getMailbox());
-  //printf("mailbox # (current thread): %d\n",currentThread->getMailbox());
-  //printf("machine # (default): %d\n",outPktHdr.to);
+  while(true) {
+    ReceiveMessage(myMailboxNum, reply, &inPktHdr, &inMailHdr);
+    if(reply->op == MSG_REPLY) {
+      return;
+    }
+    NetRequest *request = new NetRequest;
+    request->msg = *reply;
+    request->machineNum = inPktHdr.from;
+    request->mailboxNum = inMailHdr.from;
+    DeferNetRequest(deferred, request, false);
+  }
+}
 
-  outMailHdr.from = currentThread->getMailbox();
-  outMailHdr.length = strlen(buffer)+1;
+bool IsMVRequest(Message *msg) {
+  return msg->op == MSG_GET_MV || msg->op == MSG_SET_MV || msg->op == MSG_BATCH;
+}
 
-  bool success = postOffice->Send(outPktHdr, outMailHdr, buffer);
+void ServeMVRequests(int myMailboxNum, List *deferred, NetRequest *first) {
+  // Send "first", a GetMV, SetMV or batch request, to the servers
+  // together with the MV requests queued up behind it, as one batch
+  // per server, and answer each of them from the servers' replies.
+  // This is one round trip instead of one per request.
+  NetRequest *waiters[MaxBatchItems];
+  int numWaiters = 0;
+  NetRequest *next = new NetRequest;
+  Message batch(MSG_BATCH);
+  Message reply;
+  int values[MaxBatchItems]; //the answer to each item of batch
+  int *seqs = new int[numServers]; //of each server's part, or -1
+  int numSent = 0;
+  int i, j, k, n, server;
+
+  *next = *first;
+  while(true) {
+    n = (next->msg.op == MSG_BATCH) ? next->msg.numItems : 1;
+    if(batch.numItems + n > MaxBatchItems) {
+      //no room for it: it goes first next time
+      DeferNetRequest(deferred, next, true);
+      break;
+    }
+    if(next->msg.op == MSG_BATCH) {
+      for(i = 0; i < n; i++) {
+	batch.itemOp[batch.numItems] = next->msg.itemOp[i];
+	batch.itemArg1[batch.numItems] = next->msg.itemArg1[i];
+	batch.itemArg2[batch.numItems] = next->msg.itemArg2[i];
+	batch.numItems++;
+      }
+    } else {
+      batch.itemOp[batch.numItems] = next->msg.op;
+      batch.itemArg1[batch.numItems] = next->msg.arg1;
+      batch.itemArg2[batch.numItems] = next->msg.arg2;
+      batch.numItems++;
+    }
+    waiters[numWaiters++] = next;
+    if(numWaiters == MaxBatchItems) {
+      break;
+    }
 
-  if(!success) {
-    printf("The postOffice Send failed.\n");
-    interrupt->Halt();
+    //take whatever else is already waiting, as long as it is for MVs
+    next = new NetRequest;
+    if(!NextNetRequest(myMailboxNum, deferred, next, false)) {
+      delete next;
+      break;
+    }
+    if(!IsMVRequest(&next->msg)) {
+      DeferNetRequest(deferred, next, true);
+      break;
+    }
   }
 
-  postOffice->Receive(currentThread->getMailbox(), &inPktHdr, &inMailHdr, buffer);
-  printf("Got \"%s\" from %d, box %d\n",buffer,inPktHdr.from,inMailHdr.from);
-  fflush(stdout);
-  
-  cout<<"CreateMV: (buffer): "<<buffer<<endl;
+  DEBUG('n',"Network Thread: batching %d MV requests (%d items)\n", numWaiters, batch.numItems);
 
-  ss.clear();
-  ss.str(buffer);
-  int lockID_rec;
-  ss>>lockID_rec;
+  //send every server its part of the batch before waiting for any of
+  //them, so they all work on it at once
+  for(server = 0; server < numServers; server++) {
+    Message part(MSG_BATCH);
 
-  cout<<"lockID_rec: "<<lockID_rec<<endl;
+    for(i = 0; i < batch.numItems; i++) {
+      if(ServerForId(batch.itemArg1[i]) == server) {
+	part.itemOp[part.numItems] = batch.itemOp[i];
+	part.itemArg1[part.numItems] = batch.itemArg1[i];
+	part.itemArg2[part.numItems] = batch.itemArg2[i];
+	part.numItems++;
+      }
+    }
+    seqs[server] = -1;
+    if(part.numItems == 0) {
+      continue;
+    }
+    part.arg1 = part.numItems;
+    part.seq = seqs[server] = NextMessageSeq();
+    SendMessage(&part, server, 0, myMailboxNum);
+    numSent++;
+  }
 
-  return lockID_rec; //will be -1 if lock table is full
+  for(i = 0; i < batch.numItems; i++) {
+    values[i] = MessageError;
+  }
+  while(numSent > 0) {
+    AwaitServerReply(myMailboxNum, &reply, deferred);
+    for(server = 0; server < numServers && seqs[server] != reply.seq; server++) {
+    }
+    if(server == numServers) {
+      DEBUG('n',"Network Thread: stray reply %d\n", reply.seq);
+      continue;
+    }
+    //the server's answers are in the order of its items in the batch
+    for(i = 0, k = 0; i < batch.numItems; i++) {
+      if(ServerForId(batch.itemArg1[i]) == server) {
+	if(k < reply.numItems) {
+	  values[i] = reply.itemArg1[k];
+	}
+	k++;
+      }
+    }
+    seqs[server] = -1;
+    numSent--;
+  }
+  delete[] seqs;
+
+  //hand each waiter its part of the answer, in the order they were batched
+  k = 0;
+  for(i = 0; i < numWaiters; i++) {
+    Message *msg = &waiters[i]->msg;
+
+    if(msg->op == MSG_BATCH) {
+      Message answer(MSG_REPLY, msg->numItems);
+
+      answer.seq = msg->seq;
+      answer.numItems = msg->numItems;
+      for(j = 0; j < msg->numItems; j++, k++) {
+	answer.itemOp[j] = msg->itemOp[j];
+	answer.itemArg1[j] = values[k];
+	answer.itemArg2[j] = msg->itemArg2[j];
+      }
+      SendMessage(&answer, waiters[i]->machineNum, waiters[i]->mailboxNum, myMailboxNum);
+    } else {
+      if(msg->op == MSG_GET_MV) {
+	SendReply(msg, values[k], 0, waiters[i]->machineNum, waiters[i]->mailboxNum, myMailboxNum);
+      }
+      k++;
+    }
+    delete waiters[i];
+  }
 }
+#endif
 
 void netThread() {
-  
-  int numClients = 0;
-  Member clients[1000]; //other Network Threads
-
-
+#ifdef NETWORK
   int myMailboxNum = currentThread->getMailbox(); //currentThread->mailbox;
   
   Lock *AcquireQueueLock = new Lock("acquireQueueLock");
@@ -1335,297 +1199,109 @@ void netThread() {
   int numUserProgs = 0;
   bool registered = false; //set to true when this network thread (and all the other members) register with the server
   Lock* MyUserProgsLock = new Lock("NT User Progs Lock");
+
+  Member groupMembers[1000]; //the group, as the server sends it
+  int numClientsResp = 0; //members of it received so far
+
+  List *deferred = new List; //requests that came in while waiting for the server
+  NetRequest request;
+  Message &msg = request.msg;
+  Message reply;
   
   while(true) {
     // get the message 
-    // determine what to do with the message
-    stringstream ss;
-
-    PacketHeader outPktHdr, inPktHdr;
-    MailHeader outMailHdr, inMailHdr;
-    char buffer[MaxMailSize];
-    char* param = new char;
-    char* param2 = new char; //second param, if needed
-    char* request = new char;
-    char* response = new char;
-
-    int tokenID = -2;
-
-    string currentClientResp;
-    
-    int numClientsResp = 0;
-
-    
-    //outPktHdr.to = 0;
-    //outMailHdr.to = 0;
-    outMailHdr.from = myMailboxNum;
-    //outMailHdr.length = strlen(buffer)+1;
-    
-    //bool success = postOffice->Send(outPktHdr, outMailHdr, buffer);
-    
-    //if(!success) {
-    //printf("The postOffice Send failed.\n");
-    //interrupt->Halt();
-    //}
-    
-    postOffice->Receive(myMailboxNum, &inPktHdr, &inMailHdr, buffer); 
-    // printf("Network Thread %d: Got \"%s\" from %d, box %d\n",currentThread->getMailbox(),buffer,inPktHdr.from,inMailHdr.from);
-    fflush(stdout);
-    
-    ss.str(buffer);
-    ss >> request;
-    ss >> param;
-
-    // printf("NT: request=\"%s\"\n",request);
-
-    RequestType r = getNetThreadRequestType(request);
-
-    int myClientIndex = -1;
-    string clientListStr = "";
-    string nextWord = "";
-
-    bool canReleaseToken = false;
-    int releaseMyTokenIndex = -1;
+    // determine what to do with the message
+    NextNetRequest(myMailboxNum, deferred, &request, true);
 
-    int fromMailbox, fromMachine;
-    bool success;
+    int fromMailbox = request.mailboxNum;
+    int fromMachine = request.machineNum;
+    int tokenID;
+    bool tokenNeeded;
+    int i;
     
-    switch(r) {
-    case CREATE_LOCK:
+    switch(msg.op) {
+    case MSG_CREATE_LOCK:
       // If this is a create lock
-      // send message to server
-
-      ss.clear();
-      ss<<"C "<<param;
-      ss>>buffer;
-
-      fromMailbox = inMailHdr.from;
-      fromMachine = inPktHdr.from;
-      outPktHdr.to = 0;
-      outMailHdr.to = 0;
-      outMailHdr.length = strlen(buffer) + 1;
-      success = postOffice->Send(outPktHdr, outMailHdr, buffer);
-      if(!success) {
-	printf("The post office send failed.\n");
-	interrupt->Halt();
-      }
-      // Sends out the token id for every new message, even with OK message     
-      postOffice->Receive(myMailboxNum, &inPktHdr, &inMailHdr, buffer);
-      //printf("Network Thread: Got \"%s\" from %d, box %d\n",buffer,inPktHdr.from,inMailHdr.from);
-      fflush(stdout);
-      // Parse the message, and the token id
-      // which will be an integer
-      ss.clear();
-      ss.str(buffer);
-      int lockID_rec;
-      ss>>lockID_rec;
-
-      //string nextWord;
-      ss>>nextWord;
-      if(nextWord == "dup") {
+      // send message to the server that owns the name
+      SendMessage(&msg, ServerForName(msg.name), 0, myMailboxNum);
+      AwaitServerReply(myMailboxNum, &reply, deferred);
+
+      if(reply.arg1 >= 0 && reply.arg2 == 0) {
+	//this token is new: send it to my neighbor (start the cycle)
+	Message token(MSG_TOKEN, reply.arg1);
+	SendMessage(&token, nextClient.machineNum, nextClient.mailboxNum, myMailboxNum);
+      } else {
 	//this lock already existed, it is not new
 	//do not send the token around (it is not my token)
-
-	//printf("Network Thread: The token (id=%d) already existed.\n",lockID_rec);
-	
-      } else {
-
-	//printf("Network Thread: Received (new) token ID %d\n",lockID_rec);
-
-	//send the token to my neighbor (start the cycle)
-      
-	string tokenStr = "T ";
-	string tokenNumStr ="";
-	
-	ss.clear();
-	ss<<lockID_rec;
-	tokenNumStr = ss.str();
-	//ss>>tokenNumStr;
-	//cout<<"tokenNumStr:"<<tokenNumStr<<endl;
-
-	tokenStr.append(tokenNumStr);
-	strcpy(buffer,tokenStr.c_str());
-	//ss>>buffer;
-
-	//cout<<"buffer: "<<buffer<<endl;
-	outPktHdr.to = nextClient.machineNum;
-	outMailHdr.to = nextClient.mailboxNum;
-	outMailHdr.length = strlen(buffer) + 1;
-	success = postOffice->Send(outPktHdr, outMailHdr, buffer);
-	if(!success) {
-	  printf("The post office send failed.\n");
-	  interrupt->Halt();
-	}
-
       }
 
       //send the token number to the caller
-      ss.clear();
-      ss<<lockID_rec;
-      ss>>buffer;
-      outPktHdr.to = fromMachine;
-      outMailHdr.to = fromMailbox;
-      outMailHdr.length = strlen(buffer) + 1;
-      success = postOffice->Send(outPktHdr, outMailHdr, buffer);
-      if(!success) {
-	printf("The post office send failed.\n");
-	interrupt->Halt();
-      }
-
+      SendReply(&msg, reply.arg1, reply.arg2, fromMachine, fromMailbox, myMailboxNum);
       break;
-    case ACQUIRE:
-      // Acquire a lock
-      ss>>param2;
-      ss.clear();
-      //ss.str(param2);
-      //ss>>tokenID;
-      tokenID = atoi(param2);
-      
 
-      //cout<<"NT: UP wants to acquire token id="<<tokenID<<endl;
+    case MSG_ACQUIRE:
+      // Acquire a lock: wait for its token to come around
+      tokenID = msg.arg1;
       AcquireQueueLock->Acquire();
-      acquireQueue[acquireQueueLength].machineNum = inPktHdr.from;
-      acquireQueue[acquireQueueLength].mailboxNum = inMailHdr.from;
+      acquireQueue[acquireQueueLength].machineNum = fromMachine;
+      acquireQueue[acquireQueueLength].mailboxNum = fromMailbox;
       acquireQueue[acquireQueueLength].tokenNum = tokenID;
+      acquireQueue[acquireQueueLength].seq = msg.seq;
       acquireQueueLength++;
       AcquireQueueLock->Release();
-      
-      
       break;
-    case RELEASE:
-      ss>>param2;
-      ss.clear();
-      //ss.str(param2);
-      //ss>>tokenID;
-      tokenID = atoi(param2);
-      
 
-      //cout<<"NT: UP wants to release token id="<<tokenID<<endl;
-
-      for(int i = 0; i < myTokensLength; i++) {
-	//if(myTokens[i].tokenNum == tokenID && myTokens[i].machineNum == inPktHdr.from && myTokens[i].mailboxNum == inMailHdr.from) {
+    case MSG_RELEASE:
+      tokenID = msg.arg1;
+      for(i = 0; i < myTokensLength; i++) {
 	if(myTokens[i].tokenNum == tokenID) {
-	  //The release request came from the same person who requested the token
-	  canReleaseToken = true;
-	  releaseMyTokenIndex = i;
 	  break;
 	}
       }
 
-      if(canReleaseToken) {
-	//The release request came from the same person who requested the token
-	for(int i=releaseMyTokenIndex; i < myTokensLength-1; i++) {
+      if(i < myTokensLength) {
+	//one of my user programs has the token: send it on
+	for(; i < myTokensLength-1; i++) {
 	  myTokens[i] = myTokens[i+1];
 	}
 	myTokensLength--;
 
-	//ss.clear();
-	//ss << "T "<< tokenID;
-	//ss >> buffer;
-
-	sprintf(buffer, "T %d", tokenID);
-       
-	outPktHdr.to = nextClient.machineNum;
-	outMailHdr.to = nextClient.mailboxNum;
-	outMailHdr.from = myMailboxNum;
-	outMailHdr.length = strlen(buffer)+1;
-
-	printf("NT: Sending token %d (after release) to %d,%d\n",tokenID,outPktHdr.to,outMailHdr.to);
-	//printf("NT: buffer: %s\n",buffer);
-       
-	bool tokenSuccess = postOffice->Send(outPktHdr, outMailHdr, buffer);
-	if(!tokenSuccess) {
-	  printf("The post office send failed.\n");
-	  interrupt->Halt();
-	}
-
+	DEBUG('n',"NT: Sending token %d (after release) to %d,%d\n",tokenID,nextClient.machineNum,nextClient.mailboxNum);
+	Message token(MSG_TOKEN, tokenID);
+	SendMessage(&token, nextClient.machineNum, nextClient.mailboxNum, myMailboxNum);
       } else {
 	//the user doesn't have permission to release this lock
-	//printf("Network Thread: The user does not have permission to release this token.\n");
-      }
-
-
-
-      // On release, just send the token to the next UP
-      /*
-      AcquireQueueLock->Acquire();
-      if(acquireQueueLength == 0) {
-         //send token to the next UP
-      } else {
-         //send msg to the first thread waiting
-
-	 outPktHdr.to = acquireQueue[0].machineNum;
-	 outMailHdr.from = acquireQueue[0].mailboxNum;
-	 
-	 for(int i=1; i < acquireQueueLength; i++) {
-	    acquireQueue[i-1] = acquireQueue[i];
-	 }
-	 acquireQueueLength--;
-	 AcquireQueueLock->Release();
-
-	 //TODO- send token # to the 1st thread waiting
-	 postOffice->Send();
       }
-      */
       break;
-    case REGISTER:
-
-       ss.clear();
-       ss << "J";
-       ss >> buffer;
 
-       MyUserProgsLock->Acquire();
-       myUserProgs[numUserProgs].machineNum = inPktHdr.from;
-       myUserProgs[numUserProgs].mailboxNum = inMailHdr.from;
-       numUserProgs++;
-       MyUserProgsLock->Release();
-       
-       outPktHdr.to = 0;
-       outMailHdr.to = 0;
-       outMailHdr.from = myMailboxNum;
-       outMailHdr.length = strlen(buffer)+1;
-       
-       bool regSuccess = postOffice->Send(outPktHdr, outMailHdr, buffer);
-       if(!regSuccess) {
-	 printf("The post office send failed.\n");
-	 interrupt->Halt();
-       }
+    case MSG_REGISTER:
+      MyUserProgsLock->Acquire();
+      myUserProgs[numUserProgs].machineNum = fromMachine;
+      myUserProgs[numUserProgs].mailboxNum = fromMailbox;
+      numUserProgs++;
+      MyUserProgsLock->Release();
 
-       break;
+      SendMessage(&msg, 0, 0, myMailboxNum);
+      break;
        
-    case REGISTER_RESPONSE:
-      ss.clear();
-
-      ss.str(buffer);
-
-      //string currentClientResp;
-      currentClientResp = "";
-      numClientsResp = 0;
+    case MSG_MEMBERS:
+      // the member list may take several messages; arg2 says where
+      // this part of it goes
+      for(i = 0; i < msg.numMembers && msg.arg2 + i < 1000; i++) {
+	groupMembers[msg.arg2 + i].machineNum = msg.memberMachine[i];
+	groupMembers[msg.arg2 + i].mailboxNum = msg.memberMailbox[i];
+      }
+      numClientsResp += msg.numMembers;
+      if(numClientsResp < msg.arg1) {
+	break;
+      }
+      numClientsResp = msg.arg1;
 
-      //Member clients[1000];
       printf("Member List Received:\n");
-      //int myClientIndex = -1;
-      while( getline(ss, currentClientResp, ' ')) {
-	//printf("starting\n");
-	//cout<<"\""<<currentClientResp<<"\""<<endl;
-	string registerResponseMsgTitle = "X";
-	if(currentClientResp == registerResponseMsgTitle) {
-	  continue;
+      for(i = 0; i < numClientsResp; i++) {
+	if(groupMembers[i].machineNum == postOffice->getNetAddr() && groupMembers[i].mailboxNum == myMailboxNum) {
+	  myClientID = i;
 	}
-	//printf("currentClientResp=%s\n",currentClientResp);
-	int firstCommaPos = currentClientResp.find_first_of(",");
-	string machineNumStr = currentClientResp.substr(0,firstCommaPos);
-	string mailboxNumStr = currentClientResp.substr(firstCommaPos+1);
-	int machineNum = atoi(machineNumStr.c_str());
-	int mailboxNum = atoi(mailboxNumStr.c_str());
-	if(machineNum == postOffice->getNetAddr() && mailboxNum == myMailboxNum) {
-	  myClientID = numClientsResp;
-	}
-	clients[numClientsResp].machineNum = machineNum;
-	clients[numClientsResp].mailboxNum = mailboxNum;
-	numClientsResp++;
-	//printf("   Machine: %d, Mailbox: %d\n", machineNum, mailboxNum);
-	//cout<<"machine num: "<<machineNum<<" mailbox num: "<<mailboxNum<<endl;
       }
       
       if(myClientID < 0) {
@@ -1633,101 +1309,47 @@ void netThread() {
 	printf("This network thread was not in the list of registered clients\n");
 	interrupt->Halt();
       } else {
-	if(myClientID == numClientsResp - 1) {
-	  //I am the last client in the list.
-	  //my next client is the 1st client in the list
-	  nextClient.machineNum = clients[0].machineNum;
-	  nextClient.mailboxNum = clients[0].mailboxNum;
-	} else {
-	  if(numClientsResp > 1) {
-	    //I am not the only client in the list of registered clients
-	    nextClient.machineNum = clients[myClientID+1].machineNum;
-	    nextClient.mailboxNum = clients[myClientID+1].mailboxNum;
-	  } else {
-	    //I am the only client in the list of registered clients
-	    //(this case should be covered above (will never reach here)
-	  }
-	}
+	//my next client is the one after me in the list, or the 1st
+	//client in the list if I am the last one
+	nextClient = groupMembers[(myClientID + 1) % numClientsResp];
       }
 
-      //printf("Network Thread: There are %d clients (including myself)\n",numClientsResp);
-      //printf("Network Thread: My machine/mailbox is %d,%d. My neighbor is at %d,%d.\n",postOffice->getNetAddr(),myMailboxNum,nextClient.machineNum,nextClient.mailboxNum);
-
       registered = true;
       MyUserProgsLock->Acquire();
-      ss.clear();
-      ss << "REG";
-      ss >> buffer;
-      for(int i =0; i<numUserProgs; i++) {
-	outPktHdr.to = myUserProgs[i].machineNum;
-	outMailHdr.to = myUserProgs[i].mailboxNum;
-	outMailHdr.length = strlen(buffer)+1;
-	bool rrSuccess = postOffice->Send(outPktHdr, outMailHdr, buffer);
-	if(!rrSuccess) {
-	  printf("The post office send failed.\n");
-	  interrupt->Halt();
-	}
-	
+      for(i = 0; i < numUserProgs; i++) {
+	Message done(MSG_REGISTERED);
+	SendMessage(&done, myUserProgs[i].machineNum, myUserProgs[i].mailboxNum, myMailboxNum);
       }
       MyUserProgsLock->Release();
-
       break;
-       
-    case WAIT:
-      break;
-
-    case TOKEN:
-      {
-      ss>>param2;
-      ss.clear();
-      //ss.str(param2);
-      //ss>>tokenID;
-
-      tokenID = atoi(param2);
 
-      //printf("Network Thread: Received token id=%d\n",tokenID);
-     
-      bool tokenNeeded = false;
+    case MSG_TOKEN:
+      tokenID = msg.arg1;
+      tokenNeeded = false;
 
       AcquireQueueLock->Acquire();
-      //printf("Network Thread: acquire queue length currently=%d\n",acquireQueueLength);
-      for(int i=0; i < acquireQueueLength; i++) {
+      for(i = 0; i < acquireQueueLength; i++) {
 	if(acquireQueue[i].tokenNum == tokenID) {
 	  //there is a thread waiting for this token
 	  tokenNeeded = true;
-	  outPktHdr.to = acquireQueue[i].machineNum;
-	  outMailHdr.to = acquireQueue[i].mailboxNum;
-
-	  myTokens[myTokensLength].machineNum = acquireQueue[i].machineNum;
-	  myTokens[myTokensLength].mailboxNum = acquireQueue[i].mailboxNum;
+	  myTokens[myTokensLength] = acquireQueue[i];
 	  myTokensLength++;
 
-	  //printf("My user program wants to acquire token id=%d\n",tokenID);
+	  Message granted(MSG_REPLY, tokenID);
+	  granted.seq = acquireQueue[i].seq;
+	  SendMessage(&granted, acquireQueue[i].machineNum, acquireQueue[i].mailboxNum, myMailboxNum);
 
 	  for(int j = i+1; j < acquireQueueLength; j++) {
 	    acquireQueue[j-1] = acquireQueue[j];
 	  }
 	  acquireQueueLength--;
-
-	  ss.clear();
-	  ss<<tokenID;
-	  ss>>buffer;
-	  outMailHdr.length = strlen(buffer) + 1;
-	  success = postOffice->Send(outPktHdr, outMailHdr, buffer);
-	  if(!success) {
-	    printf("The post office send failed.\n");
-	    interrupt->Halt();
-	  }
-
+	  break;
 	}
-	break;
       }
       AcquireQueueLock->Release();
 
       if(!tokenNeeded) {
 	//no one needs the token, send to the next group member
-	//TODO - send the next group member
-
 	int tempWait = 0;
 	
 	while(tempWait < 100000) {
@@ -1735,159 +1357,31 @@ void netThread() {
 	  tempWait++;
 	}
 	
-	outPktHdr.to = nextClient.machineNum;
-	outMailHdr.to = nextClient.mailboxNum; //TODO - FIX THIS
-
-	//buffer remains the same as it was received
-	outMailHdr.length = strlen(buffer) + 1;
-	success = postOffice->Send(outPktHdr, outMailHdr, buffer);
-	if(!success) {
-	  //printf("The post office send failed.\n");
-	  interrupt->Halt();
-	}
-
+	SendMessage(&msg, nextClient.machineNum, nextClient.mailboxNum, myMailboxNum);
       }
-      } // end case bracket
-      
-
       break;
 
-    case GET:
-
-      /* Tell the server you need a particular MV */
-
-      //ss.clear();
-      //ss<<"GMV "<<param;
-      //ss>>buffer;
-
-      //cout<<"GET: "<<buffer<<endl;
-
-      fromMailbox = inMailHdr.from;
-      fromMachine = inPktHdr.from;
-      outPktHdr.to = 0;
-      outMailHdr.to = 0;
-      outMailHdr.length = strlen(buffer) + 1;
-      success = postOffice->Send(outPktHdr, outMailHdr, buffer);
-      if(!success) {
-	//printf("The post office send failed.\n");
-	interrupt->Halt();
-      }
-
-      /* Wait for the server for the MV */
-
-      // Sends out the token id for every new message, even with OK message     
-      postOffice->Receive(myMailboxNum, &inPktHdr, &inMailHdr, buffer);
-      //printf("Network Thread: Got \"%s\" from %d, box %d\n",buffer,inPktHdr.from,inMailHdr.from);
-      fflush(stdout);
-      // Parse the message, and the token id
-      // which will be an integer
-      ss.clear();
-      ss.str(buffer);
-
-      /* Send the MV to the waiting thread */
-      outPktHdr.to = fromMachine;
-      outMailHdr.to = fromMailbox;
-      success = postOffice->Send(outPktHdr, outMailHdr, buffer);
-      if(!success) {
-	printf("The post office send failed. \n");
-	interrupt->Halt();
-      }
-
+    case MSG_GET_MV:
+    case MSG_SET_MV:
+    case MSG_BATCH:
+      /* Get or set the MVs on the server, along with any other MV requests */
+      /* already waiting, and send the values to the waiting threads */
+      ServeMVRequests(myMailboxNum, deferred, &request);
       break;
-    case SET:
-      
-      /* Tell the server to set a particular MV */
-      //ss >> param2;
-
-      //ss.clear();
-      //ss<<"SMV "<<param<<" "<<param2;
-      //ss>>buffer;
-
-      //cout<<"SET: "<<buffer<<endl;
-
-      fromMailbox = inMailHdr.from;
-      fromMachine = inPktHdr.from;
-      outPktHdr.to = 0;
-      outMailHdr.to = 0;
-      outMailHdr.length = strlen(buffer) + 1;
-      success = postOffice->Send(outPktHdr, outMailHdr, buffer);
-      if(!success) {
-	//printf("The post office send failed.\n");
-	interrupt->Halt();
-      }
-
-      /* Wait for OK replay from server */
-
-      /* Tell the waiting thread that everything is okay */
 
+    case MSG_CREATE_MV:
+      /* Send message to the server that owns the name to create a new MV, and return the id of the MV to the thread */
+      SendMessage(&msg, ServerForName(msg.name), 0, myMailboxNum);
+      AwaitServerReply(myMailboxNum, &reply, deferred);
+      SendMessage(&reply, fromMachine, fromMailbox, myMailboxNum);
       break;
-    case CREATE_MV:
-      /* Send message to the server to create a new MV */
-      //ss.clear();
-      //ss<<"CMV "<<param;
-      //ss>>buffer;
-
-      // cout<<"CreateMV: "<<buffer<<endl;
-
-      fromMailbox = inMailHdr.from;
-      fromMachine = inPktHdr.from;
-      outPktHdr.to = 0;
-      outMailHdr.to = 0;
-      outMailHdr.length = strlen(buffer) + 1;
-      success = postOffice->Send(outPktHdr, outMailHdr, buffer);
-      if(!success) {
-	//printf("The post office send failed.\n");
-	interrupt->Halt();
-      }      
-
-       // Sends out the token id for every new message, even with OK message   
-      while(true) {
-	postOffice->Receive(myMailboxNum, &inPktHdr, &inMailHdr, buffer);
-	string msg = buffer;
-	if(msg.find_first_of("T") != string::npos) {
-	  //this is a token
-	  outPktHdr.to = nextClient.machineNum;
-	  outMailHdr.to = nextClient.mailboxNum;
-	  success = postOffice->Send(outPktHdr, outMailHdr, buffer);
-	  if(!success) {
-	    //printf("The post office send failed. \n");
-	    interrupt->Halt();
-	  }
-	} else {
-	  break;
-	}
-      }
-      printf("Network Thread: Got \"%s\" from %d, box %d\n",buffer,inPktHdr.from,inMailHdr.from);
-      fflush(stdout);
-      // Parse the message, and the token id
-      // which will be an integer
-      //ss.clear();
-      //ss.str(buffer);
-
-      /* Send the MV to the waiting thread */
-      outPktHdr.to = fromMachine;
-      outMailHdr.to = fromMailbox;
-      outPktHdr.from = postOffice->getNetAddr();
-      outMailHdr.from = myMailboxNum;
-      success = postOffice->Send(outPktHdr, outMailHdr, buffer);
-      if(!success) {
-	//printf("The post office send failed. \n");
-	interrupt->Halt();
-      }
-
-      cout<<"CreateMV: sent to UP: "<<buffer<<endl;
-
-      /* and return the id of the MV to the thread */
 
+    default:
+      DEBUG('n',"Network Thread: unexpected op %d from %d, box %d\n", msg.op, fromMachine, fromMailbox);
       break;
-      
-      //case 'SignalReply':
-      //break;
-      //case 'RegistrationReply':
-      //break;
     }
   }
-  
+#endif
 }
 
 void execThread() {
@@ -1921,6 +1415,553 @@ void kernelFunc(int vaddr) {
   machine->Run();
 }
 
+// The IPT is indexed by physical page, so a TLB entry's physicalPage
+// is a direct link back to the IPT entry of the frame it maps.  These
+// routines use it to keep the IPT's use/dirty bits up to date without
+// searching the IPT, and pick pages to evict using those bits.
+
+static int clockHand = 0;	// next frame the page replacement looks at
+
+void SaveTLBEntry(int slot) {
+  // Copy the use and dirty bits of a TLB slot back to the IPT before
+  // the slot is replaced or invalidated
+  TranslationEntry *entry = &machine->tlb[slot];
+
+  if(!entry->valid) {
+    return;
+  }
+  if(entry->use == TRUE) {
+    ipt[entry->physicalPage].use = TRUE;
+  }
+  if(entry->dirty == TRUE) {
+    ipt[entry->physicalPage].dirty = TRUE;
+  }
+}
+
+int ChooseVictim(AddrSpace *owner) {
+  // Pick a frame to evict with a second chance clock over the frames.
+  // A page that hasn't been used since the hand last passed it goes
+  // first, and of those a clean one is preferred since it doesn't have
+  // to be written to the swap file. Used pages get their use bit
+  // cleared and are passed over until the next time around.
+  // If "owner" is not NULL, only its pages are considered. Frames
+  // pinned for a kernel transfer are never picked.
+  int i, round, frame;
+
+  // the TLB has the freshest use/dirty bits
+  for(i = 0; i < TLBSize; i++) {
+    SaveTLBEntry(i);
+    machine->tlb[i].use = FALSE;
+  }
+
+  for(round = 0; round < 2; round++) {
+    for(i = 0; i < NumPhysPages; i++) {
+      frame = (clockHand + i) % NumPhysPages;
+      if(owner != NULL && ipt[frame].space != owner) {
+	continue;
+      }
+      if(ipt[frame].valid && !ipt[frame].pinned && !ipt[frame].use && !ipt[frame].dirty) {
+	clockHand = (frame + 1) % NumPhysPages;
+	return frame;
+      }
+    }
+    for(i = 0; i < NumPhysPages; i++) {
+      frame = clockHand;
+      clockHand = (clockHand + 1) % NumPhysPages;
+      if(!ipt[frame].valid || ipt[frame].pinned || (owner != NULL && ipt[frame].space != owner)) {
+	continue;
+      }
+      if(ipt[frame].use) {
+	ipt[frame].use = FALSE;
+	continue;
+      }
+      return frame;
+    }
+  }
+  if(owner != NULL) {
+    // The owner has nothing in the IPT to give up, so take from anyone
+    return ChooseVictim(NULL);
+  }
+  // No frame is owned by the IPT, so there's nothing better to pick
+  frame = clockHand;
+  clockHand = (clockHand + 1) % NumPhysPages;
+  return frame;
+}
+
+void MapFrame(int frame, AddrSpace *space, int vpn) {
+  // Put page vpn of space into the IPT entry for frame, taking the
+  // frame away from whoever had it
+  if(ipt[frame].valid && ipt[frame].space != NULL) {
+    ipt[frame].space->residentPages--;
+  }
+  ipt[frame].physicalPage  = frame;
+  ipt[frame].virtualPage   = vpn;
+  ipt[frame].valid         = TRUE;
+  ipt[frame].use           = FALSE;
+  ipt[frame].dirty         = FALSE;
+  ipt[frame].readOnly      = FALSE;
+  ipt[frame].processId     = space->id;
+  ipt[frame].space         = space;
+  ipt[frame].lastUseSample = 0;
+  space->residentPages++;
+  if(space->id >= 0 && space->id < MaxProcessStats) {
+    stats->processResident[space->id] = space->residentPages;
+  }
+}
+
+// Pages the pageout daemon has taken out of memory but is still writing
+// to swap. Their contents are in pageoutBuffer, in slot order, and a
+// fault on one of them copies it from there instead of reading swap.
+
+static char pageoutBuffer[PageoutBatch * PageSize];
+static int pageoutSlots[PageoutBatch];	// swap slot of each buffered page
+static int pageoutCount = 0;		// number of buffered pages
+static Semaphore *pageoutWanted = NULL;	// wakes up the daemon
+static bool pageoutActive = FALSE;	// daemon is freeing frames
+
+bool UnmapFrame(int frame) {
+  // Take frame away from the page that owns it: invalidate any TLB
+  // entry for it (saving its bits first) and the IPT entry. A dirty
+  // page of a mapped file is written back to the file here. Returns
+  // TRUE if the page is dirty and goes to swap; it is then given a
+  // swap slot and the caller has to write it there.
+  AddrSpace *owner = ipt[frame].space;
+  int vpn = ipt[frame].virtualPage;
+  int i;
+
+  if(machine->tlb != NULL) {
+    for(i = 0; i < TLBSize; i++) {
+      if(machine->tlb[i].valid && machine->tlb[i].physicalPage == frame) {
+	SaveTLBEntry(i);
+	machine->tlb[i].valid = FALSE;
+      }
+    }
+  }
+  if(!ipt[frame].valid || owner == NULL) {
+    return FALSE;
+  }
+  owner->residentPages--;
+  ipt[frame].valid = FALSE;
+  if(!ipt[frame].dirty) {
+    return FALSE;
+  }
+  MappedFile *m = owner->FindMapping(vpn);
+  if(m != NULL) {
+    // Mapped pages go back to their file instead of to swap
+    int offset = (vpn - m->firstPage) * PageSize;
+    int len = (m->length - offset < PageSize) ? m->length - offset : PageSize;
+    m->file->WriteAt(&(machine->mainMemory[frame*PageSize]), len, offset);
+    stats->numMappedWrites++;
+    return FALSE;
+  }
+  if(owner->swapLoc[vpn] == -1) {
+    owner->swapLoc[vpn] = swapCounter++;
+  }
+  return TRUE;
+}
+
+void EvictFrame(int frame) {
+  // Evict the page in frame right now, writing it to the swap file if
+  // it is dirty. Used when a fault finds no free frame.
+  AddrSpace *owner = ipt[frame].space;
+  int vpn = ipt[frame].virtualPage;
+
+  IntStatus oldLevel = interrupt->SetLevel(IntOff); // Disable Interrupts
+  if(UnmapFrame(frame)) {
+    DEBUG('g',"page %d is dirty\n", frame);
+    swapFile->WriteAt(&(machine->mainMemory[frame*PageSize]),PageSize,owner->swapLoc[vpn]*PageSize);
+    stats->numPageouts++;
+    stats->numSwapWrites++;
+  }
+  interrupt->SetLevel(oldLevel); // Re-Enable Interrupts
+}
+
+void LoadPage(AddrSpace *space, int vpn, int frame) {
+  // Read page vpn of space into frame: from its file if it is mapped,
+  // from the swap file if it has been written there (or from the
+  // pageout buffer if that write is still going on), otherwise from
+  // the executable
+  int slot = space->swapLoc[vpn];
+  MappedFile *m = space->FindMapping(vpn);
+  int i;
+
+  if(m != NULL) {
+    // Past the end of the file the page reads as zeros
+    DEBUG('c',"load mapped page %d from its file\n", vpn);
+    bzero(&(machine->mainMemory[frame*PageSize]), PageSize);
+    m->file->ReadAt(&(machine->mainMemory[frame*PageSize]),PageSize,(vpn - m->firstPage)*PageSize);
+    return;
+  }
+  if(slot == -1) {
+    DEBUG('c',"load from executable into memory\n");
+    space->memoryLoad(vpn, frame);
+    return;
+  }
+  for(i = 0; i < pageoutCount; i++) {
+    if(pageoutSlots[i] == slot) {
+      bcopy(&pageoutBuffer[i*PageSize], &(machine->mainMemory[frame*PageSize]), PageSize);
+      return;
+    }
+  }
+  DEBUG('c',"load page %d from swap slot %d\n", vpn, slot);
+  swapFile->ReadAt(&(machine->mainMemory[frame*PageSize]),PageSize,slot*PageSize);
+}
+
+void PageoutDaemon(int dummy) {
+  // Kernel thread that keeps a reserve of free frames. Each round picks
+  // up to PageoutBatch victims with interrupts off, copying the dirty
+  // ones into pageoutBuffer and freeing their frames right away; then
+  // the buffer is written to swap, one write for each run of
+  // consecutive slots (newly assigned slots always are consecutive).
+  int frame, n, i, j;
+  bool stuck;
+
+  for(;;) {
+    pageoutWanted->P();
+    stuck = FALSE;
+    while(!stuck && bitmap->NumClear() < FreeFrameTarget) {
+      IntStatus oldLevel = interrupt->SetLevel(IntOff);
+      n = 0;
+      while(n < PageoutBatch && bitmap->NumClear() < FreeFrameTarget) {
+	frame = ChooseVictim(NULL);
+	if(!ipt[frame].valid) {
+	  stuck = TRUE; // nothing left that we can evict
+	  break;
+	}
+	AddrSpace *owner = ipt[frame].space;
+	int vpn = ipt[frame].virtualPage;
+	if(UnmapFrame(frame)) {
+	  pageoutSlots[n] = owner->swapLoc[vpn];
+	  bcopy(&(machine->mainMemory[frame*PageSize]), &pageoutBuffer[n*PageSize], PageSize);
+	  n++;
+	}
+	bitmap->Clear(frame);
+      }
+      pageoutCount = n;
+      interrupt->SetLevel(oldLevel);
+
+      for(i = 0; i < n; i = j) {
+	for(j = i + 1; j < n && pageoutSlots[j] == pageoutSlots[j-1] + 1; j++)
+	  ;
+	swapFile->WriteAt(&pageoutBuffer[i*PageSize], (j-i)*PageSize, pageoutSlots[i]*PageSize);
+	stats->numSwapWrites++;
+      }
+      stats->numPageouts += n;
+      pageoutCount = 0;
+    }
+    pageoutActive = FALSE;
+  }
+}
+
+void WakePageoutDaemon() {
+  // Start the pageout daemon the first time it is needed, and wake it
+  // up if it isn't already freeing frames
+  if(pageoutWanted == NULL) {
+    pageoutWanted = new Semaphore("PageoutWanted", 0);
+    Thread *t = new Thread("PageoutDaemon");
+    t->Fork(PageoutDaemon, 0);
+  }
+  if(!pageoutActive) {
+    pageoutActive = TRUE;
+    pageoutWanted->V();
+  }
+}
+
+void RecordPageLoad(AddrSpace *space) {
+  // Count a page fault that had to load a page, for page fault
+  // frequency and for the per-process statistics
+  stats->numPageFaults++;
+  space->faultsThisSample++;
+  if(space->id >= 0 && space->id < MaxProcessStats) {
+    if(stats->processFaults[space->id] == 0) {
+      stats->processStart[space->id] = stats->totalTicks;
+    }
+    stats->processFaults[space->id]++;
+    stats->processFrameLimit[space->id] = space->frameLimit;
+  }
+}
+
+void SampleWorkingSets() {
+  // Called on every timer interrupt. Every WSSampleInterval of them,
+  // estimate each process's working set from the use bits, and adjust
+  // its frame allocation by how often it has been faulting.
+  static int ticks = 0;
+  static int sample = 0;
+  int frame, i;
+  AddrSpace *space;
+
+  if(machine == NULL || ++ticks < WSSampleInterval) {
+    return;
+  }
+  ticks = 0;
+  sample++;
+
+  if(machine->tlb != NULL) {
+    for(i = 0; i < TLBSize; i++) {
+      SaveTLBEntry(i);
+      machine->tlb[i].use = FALSE;
+    }
+  }
+
+  // Reset the estimates of everyone who has pages in memory
+  for(frame = 0; frame < NumPhysPages; frame++) {
+    if(ipt[frame].valid && ipt[frame].space != NULL) {
+      ipt[frame].space->workingSet = 0;
+    }
+  }
+  // A page is in the working set if it was used in the last WSWindow
+  // samples. Its use bit is cleared so we can tell next time.
+  for(frame = 0; frame < NumPhysPages; frame++) {
+    if(!ipt[frame].valid || ipt[frame].space == NULL) {
+      continue;
+    }
+    if(ipt[frame].use) {
+      ipt[frame].lastUseSample = sample;
+      ipt[frame].use = FALSE;
+    }
+    if(ipt[frame].lastUseSample > 0 && sample - ipt[frame].lastUseSample < WSWindow) {
+      ipt[frame].space->workingSet++;
+    }
+  }
+  // Page fault frequency: grow the allocation of processes faulting a
+  // lot, shrink it for those that hardly fault
+  for(frame = 0; frame < NumPhysPages; frame++) {
+    space = ipt[frame].space;
+    if(!ipt[frame].valid || space == NULL || space->lastSample == sample) {
+      continue;
+    }
+    space->lastSample = sample;
+    if(space->faultsThisSample > PFFUpper) {
+      if(space->frameLimit < space->residentPages) {
+	space->frameLimit = space->residentPages;
+      }
+      space->frameLimit += PFFStep;
+      if(space->frameLimit > NumPhysPages) {
+	space->frameLimit = NumPhysPages;
+      }
+    } else if(space->faultsThisSample < PFFLower) {
+      if(space->frameLimit > space->residentPages) {
+	space->frameLimit = space->residentPages;
+      }
+      space->frameLimit -= PFFStep;
+      if(space->frameLimit < space->workingSet) {
+	space->frameLimit = space->workingSet;
+      }
+      if(space->frameLimit < MinFrameLimit) {
+	space->frameLimit = MinFrameLimit;
+      }
+    }
+    DEBUG('c',"space %d: resident %d, working set %d, faults %d, limit %d\n",
+	  space->id, space->residentPages, space->workingSet,
+	  space->faultsThisSample, space->frameLimit);
+    space->faultsThisSample = 0;
+    if(space->id >= 0 && space->id < MaxProcessStats) {
+      stats->processResident[space->id]   = space->residentPages;
+      stats->processWorkingSet[space->id] = space->workingSet;
+      stats->processFrameLimit[space->id] = space->frameLimit;
+    }
+  }
+}
+
+int FindIPTEntry(int processId, int vpn) {
+  // Return the frame holding page vpn of process processId, or -1
+  for(int i = 0; i < NumPhysPages; i++) {
+    if(ipt[i].valid && ipt[i].processId == processId && ipt[i].virtualPage == vpn) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void Prefetch(int arg) {
+  // Read-ahead batching: load the next PrefetchDepth pages along the
+  // stride the faults have been following, all in one go, so that the
+  // faults on them find them already in memory. This runs in its own
+  // kernel thread, which the faulting thread starts; it does not overlap
+  // the reads with user code (with FILESYS_STUB they are synchronous
+  // host reads), it just takes them out of the fault path. Only free
+  // frames are used: it isn't worth evicting a page someone is using to
+  // make room for a guess.
+  AddrSpace *space = (AddrSpace *)arg;
+  int k, vpn, frame;
+
+  for(k = 1; k <= PrefetchDepth; k++) {
+    vpn = space->prefetchFrom + k * space->prefetchStride;
+    if(vpn < 0 || vpn >= (int)space->NumPages() || !space->pageTable[vpn].valid) {
+      break;
+    }
+    if(FindIPTEntry(space->id, vpn) != -1) {
+      continue; // already in memory
+    }
+    if(space->residentPages >= space->frameLimit) {
+      break; // no room in our allocation
+    }
+    frame = bitmap->Find();
+    if(frame == -1) {
+      break;
+    }
+
+    // The read doesn't yield (the swap and executable reads are
+    // synchronous), so no other thread sees the frame before it holds
+    // the page
+    MapFrame(frame, space, vpn);
+    space->pageTable[vpn].physicalPage = frame;
+    LoadPage(space, vpn, frame);
+
+    DEBUG('c',"prefetched page %d into frame %d\n", vpn, frame);
+    stats->numPagesPrefetched++;
+  }
+  space->prefetching = FALSE;
+}
+
+void StartPrefetch(AddrSpace *space, int vpn, int stride) {
+  // Start a prefetch thread for this address space, unless one is
+  // already running
+  if(space->prefetching) {
+    return;
+  }
+  space->prefetching     = TRUE;
+  space->prefetchFrom    = vpn;
+  space->prefetchStride  = stride;
+  Thread *t = new Thread("Prefetcher");
+  t->Fork(Prefetch, (int)space);
+}
+
+bool HandlePageFault(int vaddress) {
+  // Make the page at vaddress usable by the current thread: find it in
+  // the IPT, or load it into a free frame (or one we evict), and put
+  // it in the TLB. Called for a PageFaultException, and by the kernel
+  // when it needs a user page itself. Returns FALSE if vaddress isn't
+  // in the address space.
+  int vpnumber = vaddress / PageSize; 
+  if(vpnumber < 0 || vpnumber >= (int)currentThread->space->NumPages() ||
+     !currentThread->space->pageTable[vpnumber].valid) {
+    // Not part of the address space (or an unmapped file)
+    DEBUG('f',"VPN %d is not in the address space\n", vpnumber);
+    return FALSE;
+  }
+  unsigned int index;
+  bool loaded = FALSE; // TRUE if the page wasn't in memory
+  bool overLimit;      // TRUE if we already have all the frames PFF allows
+
+  // Check to see if the page is in the IPT
+  int i;
+
+  for(i = 0; i < NumPhysPages; i++) {
+    // If the processId in the IPT is the same as the current thread's address space id
+    // we know they are from the same process 
+    // printf("process id is: %d, currentThread space id is: %d\n",machine->ipt[i].processId,currentThread->space->id);
+
+    // (pages that have been evicted keep their ids but aren't valid)
+    if(ipt[i].valid && ipt[i].processId == currentThread->space->id) {
+
+      // If the virtual page is the same as the current thread's address space's virtual page 
+      // then we know we found the right page
+      if(ipt[i].virtualPage == vpnumber) {
+	// THIS IS AN IPT HIT
+	// We have the virtual page 
+	// UPDATE THE TLB CODE
+	DEBUG('c',"ipt virtual page and vpn is the same\n");
+
+	// Save the bits of the TLB entry we are about to replace
+	SaveTLBEntry(tlbCounter);
+
+	machine->tlb[tlbCounter].physicalPage = ipt[i].physicalPage;
+	machine->tlb[tlbCounter].virtualPage  = ipt[i].virtualPage;
+	machine->tlb[tlbCounter].valid        = ipt[i].valid;
+	machine->tlb[tlbCounter].use          = ipt[i].use;
+	machine->tlb[tlbCounter].dirty        = ipt[i].dirty;
+	machine->tlb[tlbCounter].asid         = currentThread->space->id;
+	break;
+      } 
+      // If we get here, the page we are looking for is not in memory, so we have to load 
+      // from the executable or perhaps the swap file 
+    }
+    if(i == NumPhysPages-1) {
+      // This is an IPT Miss 
+      loaded = TRUE;
+      RecordPageLoad(currentThread->space);
+      overLimit = currentThread->space->residentPages >= currentThread->space->frameLimit;
+      if(overLimit) {
+	index = -1; // replace one of our own pages instead
+      } else {
+	index = bitmap->Find();
+      }
+
+      // Main memory is full, as is the IPT
+      if((int)index == -1) {
+	DEBUG('c',"Main memory is full\n");
+	int evictPage;
+	// Pick the page to be evicted using the use/dirty bits
+	evictPage = ChooseVictim(overLimit ? currentThread->space : NULL);
+	DEBUG('c',"evicting page %d\n",evictPage);
+	// Take the page away from its owner, saving it to swap if it is dirty
+	EvictFrame(evictPage);
+
+	// Load the new page from the swap file or the executable
+	LoadPage(currentThread->space, vpnumber, evictPage);
+
+	// Evict this page and put in the new page
+	MapFrame(evictPage, currentThread->space, vpnumber);
+
+	// Save the bits of the TLB entry we are about to replace
+	SaveTLBEntry(tlbCounter);
+
+	// UPDATE THE TLB CODE
+	machine->tlb[tlbCounter].physicalPage = evictPage;
+	machine->tlb[tlbCounter].virtualPage  = vpnumber;
+	machine->tlb[tlbCounter].valid        = TRUE;
+	machine->tlb[tlbCounter].use          = currentThread->space->pageTable[vpnumber].use;
+	machine->tlb[tlbCounter].dirty        = currentThread->space->pageTable[vpnumber].dirty;	   
+	machine->tlb[tlbCounter].asid         = currentThread->space->id;
+
+      } else {
+	// Main memory has space
+	// Update the IPT CODE
+	DEBUG('c',"the page is not inside the ipt\n");
+	MapFrame(index, currentThread->space, vpnumber);
+
+	currentThread->space->pageTable[vpnumber].physicalPage = index;
+
+	// Save the bits of the TLB entry we are about to replace
+	SaveTLBEntry(tlbCounter);
+
+	// UPDATE THE TLB CODE
+	machine->tlb[tlbCounter].physicalPage = currentThread->space->pageTable[vpnumber].physicalPage;
+	machine->tlb[tlbCounter].virtualPage  = currentThread->space->pageTable[vpnumber].virtualPage;
+	machine->tlb[tlbCounter].valid        = currentThread->space->pageTable[vpnumber].valid;
+	machine->tlb[tlbCounter].use          = currentThread->space->pageTable[vpnumber].use;
+	machine->tlb[tlbCounter].dirty        = currentThread->space->pageTable[vpnumber].dirty;	    
+	machine->tlb[tlbCounter].asid         = currentThread->space->id;
+
+	// Load it into memory
+	LoadPage(currentThread->space, vpnumber, index);
+
+	// Keep a reserve of free frames so that faults don't have to
+	// wait for a page to be written out
+	if(bitmap->NumClear() < FreeFrameReserve) {
+	  WakePageoutDaemon();
+	}
+      }
+    }   
+  }   
+
+  if(tlbCounter == TLBSize-1) {
+    tlbCounter = 0;
+  } else {
+    tlbCounter++;
+  }
+
+  // If the pages we've had to load follow a pattern, read ahead along it
+  if(loaded) {
+    int stride = currentThread->space->FaultStride(vpnumber);
+    if(stride != 0) {
+      StartPrefetch(currentThread->space, vpnumber, stride);
+    }
+  }
+  return TRUE;
+}
+
 void ExceptionHandler(ExceptionType which) {
     int type = machine->ReadRegister(2); // Which syscall?
     int rv = 0;
@@ -1957,6 +1998,27 @@ void ExceptionHandler(ExceptionType which) {
 		DEBUG('a', "Close syscall.\n");
 		Close_Syscall(machine->ReadRegister(4));
 		break;
+	    case SC_Mmap:
+		DEBUG('a', "Mmap syscall.\n");
+		rv = Mmap_Syscall(machine->ReadRegister(4),
+				  machine->ReadRegister(5));
+		break;
+	    case SC_Munmap:
+		DEBUG('a', "Munmap syscall.\n");
+		Munmap_Syscall(machine->ReadRegister(4));
+		break;
+	    case SC_GetMVs:
+		DEBUG('a', "GetMVs syscall.\n");
+		rv = MVBatch_Syscall(TRUE, machine->ReadRegister(4),
+				     machine->ReadRegister(5),
+				     machine->ReadRegister(6));
+		break;
+	    case SC_SetMVs:
+		DEBUG('a', "SetMVs syscall.\n");
+		rv = MVBatch_Syscall(FALSE, machine->ReadRegister(4),
+				     machine->ReadRegister(5),
+				     machine->ReadRegister(6));
+		break;
 	    case SC_CreateLock:
 	        DEBUG('a', "CreateLock syscall.\n");
 	        rv = CreateLock_Syscall(machine->ReadRegister(4));
@@ -2000,11 +2062,23 @@ void ExceptionHandler(ExceptionType which) {
 	    case SC_Exit:
 		int spaceid_ex;
 		spaceid_ex = currentThread->space->id;
-		for(int i = 0; i < TLBSize; i++) {
-		  // invalidate the tlb 
+		if(machine->tlb != NULL) {
+		  // invalidate this address space's entries in the tlb,
+		  // keeping the dirty bits in the IPT
 		  IntStatus oldLevel = interrupt->SetLevel(IntOff); // Disable Interrupts
-		  // machine->tlb[i].valid = FALSE;
-		  interrupt->SetLevel(oldLevel); // Disable Interrupts
+		  for(int i = 0; i < TLBSize; i++) {
+		    if(machine->tlb[i].valid && machine->tlb[i].asid == spaceid_ex) {
+		      SaveTLBEntry(i);
+		      machine->tlb[i].valid = FALSE;
+		    }
+		  }
+		  interrupt->SetLevel(oldLevel); // Re-Enable Interrupts
+		}
+		ReleaseKernelLocks();
+		// The last thread of a process takes its locks and
+		// conditions with it
+		if(--currentThread->space->numThreads == 0) {
+		  FreeKernelObjects(currentThread->space);
 		}
 		currentThread->Finish();
 		break;
@@ -2040,6 +2114,7 @@ void ExceptionHandler(ExceptionType which) {
 		  kernelThread = new Thread("CargoHandler");
 		} else if(name == 7) {
 		  kernelThread = new Thread("AirportManager");
+		  kernelThread->setPriority(MaxPriority);
 		} else {
 		  kernelThread = new Thread("kernelThread");
 		}
@@ -2047,6 +2122,7 @@ void ExceptionHandler(ExceptionType which) {
 		// is a child of the currentThread
 		//printf("address space num pages %d \n", currentThread->space->NumPages());
 		kernelThread->space = currentThread->space;
+		kernelThread->space->numThreads++;
 
 		// Create a new page table with 8 pages more of stack
 		kernelThread->space->NewPageTable();
@@ -2180,180 +2256,8 @@ void ExceptionHandler(ExceptionType which) {
 	return;
     } else if( which == PageFaultException) {
       DEBUG('f',"Page Fault Exception\n");
-      int vaddress;
-      vaddress = machine->ReadRegister(39);
-      int vpnumber = vaddress / PageSize; 
-      if(vpnumber > PageSize*NumPhysPages) {
-	printf("VPN is OUT OF BOUNDS\n");
-      }
-      unsigned int index;
-  
-      // Check to see if the page is in the IPT
-      int i;
-     
-      
-      for(i = 0; i < NumPhysPages; i++) {
-	// If the processId in the IPT is the same as the current thread's address space id
-	// we know they are from the same process 
-	// printf("process id is: %d, currentThread space id is: %d\n",machine->ipt[i].processId,currentThread->space->id);
-	
-	if(ipt[i].processId == currentThread->space->id) {
-	  
-      	  // If the virtual page is the same as the current thread's address space's virtual page 
-	  // then we know we found the right page
-	  if(ipt[i].virtualPage == vpnumber) {
-	    // THIS IS AN IPT HIT
-	    // We have the virtual page 
-	    // UPDATE THE TLB CODE
-	    DEBUG('c',"ipt virtual page and vpn is the same\n");
-
-	    for(int z = 0; z < NumPhysPages; z++) {
-	      if(machine->tlb[tlbCounter].virtualPage == ipt[z].virtualPage) {
-		if(machine->tlb[tlbCounter].dirty == TRUE) {
-		  ipt[z].dirty = TRUE;
-		}
-	      }
-	    }
-	    
-	    machine->tlb[tlbCounter].physicalPage = ipt[i].physicalPage;
-	    machine->tlb[tlbCounter].virtualPage  = ipt[i].virtualPage;
-	    machine->tlb[tlbCounter].valid        = ipt[i].valid;
-	    machine->tlb[tlbCounter].use          = ipt[i].use;
-	    machine->tlb[tlbCounter].dirty        = ipt[i].dirty;
-	    break;
-	  } 
-	  // If we get here, the page we are looking for is not in memory, so we have to load 
-	  // from the executable or perhaps the swap file 
-	}
-	if(i == NumPhysPages-1) {
-	  // This is an IPT Miss 
-	  index = bitmap->Find();
-
-	  // Main memory is full, as is the IPT
-	  if(index == -1) {
-	    DEBUG('c',"Main memory is full\n");
-	    int evictPage;
-	    // The page to be evicted is the first one in FIFO data structure
-	    evictPage = fifo[0];
-	    DEBUG('c',"evicting page %d\n",evictPage);
-	    // Check if this page has an entry in the TLB
-	    for(i = 0; i < TLBSize; i++) {
-	      if(evictPage == machine->tlb[i].physicalPage) {
-		// Rewrite it
-		IntStatus oldLevel = interrupt->SetLevel(IntOff); // Disable Interrupts
-		machine->tlb[i].valid = FALSE;
-		oldLevel = interrupt->SetLevel(oldLevel); // Disable Interrupts
-	      }
-	    }
-	    
-	    // Save the page being evicted, but only if it is dirty
-	    if(ipt[evictPage].dirty == TRUE) {
-	      DEBUG('g',"page %d is dirty\n", evictPage);
-	      // Write it to the swap file
-	      IntStatus oldLevel = interrupt->SetLevel(IntOff); // Disable Interrupts
-	      swapFile->WriteAt(&(machine->mainMemory[evictPage*PageSize]),PageSize,swapCounter*PageSize);
-	      //currentThread->space->pageTable[ipt[evictPage].virtualPage].location = 1;
-	      //currentThread->space->pageTable[ipt[evictPage].virtualPage].swapLoc = swapCounter;
-	      swapCounter++;	
-	      interrupt->SetLevel(oldLevel); // Re-Enable Interrupts
-	    }
-	    
-	    // Shift the entire fifo array
-	    for(i = 1; i < NumPhysPages; i++) {
-	      fifo[i-1] = fifo[i];
-	    }
-	    DEBUG('c',"fifocounter is: %d \n",fifoCounter);
-	    fifo[fifoCounter] = evictPage;
-	    
-	    for(i = 0; i < NumPhysPages; i++) {
-	      DEBUG('f',"fifo %d: %d\n",i,fifo[i]);
-	    }
-
-	    // If this page is inside the swap file	    
-	    // The code underneath is wrong, but its okay since we're not using the TLB
-	    if(currentThread->space->pageTable[vpnumber].physicalPage == 1){
-	      DEBUG('c',"Page %d is in the swap file\n",evictPage);
-	      //Load from swap file to main memory
-	      IntStatus oldLevel = interrupt->SetLevel(IntOff); // Disable Interrupts
-
-	      //swapFile->ReadAt(&(machine->mainMemory[evictPage*PageSize]),PageSize,currentThread->space->pageTable[vpnumber].swapLoc*PageSize);
-	      interrupt->SetLevel(oldLevel); // Re-Enable Interrupts
-	    } else {
-	      // Load the new page from executable into memory
-	      DEBUG('c',"load from executable into memory\n");
-	      currentThread->space->memoryLoad(vpnumber, evictPage);
-	    }	    
-
-	    // Evict this page and put in the new page
-	    ipt[evictPage].physicalPage = evictPage;
-	    ipt[evictPage].virtualPage  = vpnumber;
-	    ipt[evictPage].valid        = TRUE;
-	    ipt[evictPage].use          = FALSE;
-	    ipt[evictPage].dirty        = FALSE;
-	    ipt[evictPage].readOnly     = FALSE;
-	    ipt[evictPage].processId    = currentThread->space->id;
-	    
-	    for(int z = 0; z < NumPhysPages; z++) {
-	      if(machine->tlb[tlbCounter].virtualPage == ipt[z].virtualPage) {
-		if(machine->tlb[tlbCounter].dirty == TRUE) {
-		  ipt[z].dirty = TRUE;
-		}
-	      }
-	    }
-
-	    // UPDATE THE TLB CODE
-	    machine->tlb[tlbCounter].physicalPage = evictPage;
-	    machine->tlb[tlbCounter].virtualPage  = vpnumber;
-	    machine->tlb[tlbCounter].valid        = TRUE;
-	    machine->tlb[tlbCounter].use          = currentThread->space->pageTable[vpnumber].use;
-	    machine->tlb[tlbCounter].dirty        = currentThread->space->pageTable[vpnumber].dirty;	   
-
-	  } else {
-	    // Main memory has space
-	    // Update the IPT CODE
-	    DEBUG('c',"the page is not inside the ipt\n");
-	    ipt[index].physicalPage = index;
-	    ipt[index].virtualPage  = vpnumber;
-	    ipt[index].valid        = TRUE;
-	    ipt[index].use          = FALSE;
-	    ipt[index].dirty        = FALSE;
-	    ipt[index].readOnly     = FALSE;
-	    ipt[index].processId    = currentThread->space->id;
-	    
-	    fifo[fifoCounter] = index;
-	    if(fifoCounter < NumPhysPages-1) {
-	      fifoCounter++;
-	    }
-	    if(fifoCounter >= NumPhysPages) {
-	      DEBUG('c',"fifo counter is larger than numphyspages\n");
-	    }
-	    currentThread->space->pageTable[vpnumber].physicalPage = index;
-
-	    for(int z = 0; z < NumPhysPages; z++) {
-	      if(machine->tlb[tlbCounter].virtualPage == ipt[z].virtualPage) {
-		if(machine->tlb[tlbCounter].dirty == TRUE) {
-		  ipt[z].dirty = TRUE;
-		}
-	      }
-	    }
-	    
-	    // UPDATE THE TLB CODE
-	    machine->tlb[tlbCounter].physicalPage = currentThread->space->pageTable[vpnumber].physicalPage;
-	    machine->tlb[tlbCounter].virtualPage  = currentThread->space->pageTable[vpnumber].virtualPage;
-	    machine->tlb[tlbCounter].valid        = currentThread->space->pageTable[vpnumber].valid;
-	    machine->tlb[tlbCounter].use          = currentThread->space->pageTable[vpnumber].use;
-	    machine->tlb[tlbCounter].dirty        = currentThread->space->pageTable[vpnumber].dirty;	    
-	    
-	    // Load it into memory
-	    currentThread->space->memoryLoad(vpnumber, index);
-	  }
-	}   
-      }   
-      
-      if(tlbCounter == TLBSize-1) {
-	tlbCounter = 0;
-      } else {
-	tlbCounter++;
+      if(!HandlePageFault(machine->ReadRegister(BadVAddrReg))) {
+	ExceptionHandler(AddressErrorException);
       }
       return;
     } else {
@@ -2361,39 +2265,3 @@ void ExceptionHandler(ExceptionType which) {
       interrupt->Halt();
     }
 }
-
-RequestType getNetThreadRequestType(char* req) {
-  
-  if(strcmp(req, "L")==0) {
-    return CREATE_LOCK;
-  } else if(strcmp(req, "A")==0) {
-    return ACQUIRE;
-  } else if (strcmp(req, "R")==0) {
-    return RELEASE;
-  } else if (strcmp(req, "D")==0) {
-    return DESTROY_LOCK;
-  } else if (strcmp(req, "C")==0) {
-    return CREATE_CONDITION;
-  } else if (strcmp(req, "W")==0) {
-    return WAIT;
-  } else if (strcmp(req, "S")==0) {
-    return SIGNAL;
-  } else if (strcmp(req, "B")==0) {
-    return BROADCAST;
-  } else if (strcmp(req, "J")==0) {
-    return REGISTER;
-  } else if (strcmp(req, "CMV")==0) {
-    return CREATE_MV;
-  } else if (strcmp(req, "GMV")==0) {
-    return GET;
-  } else if (strcmp(req, "SMV")==0) {
-    return SET;
-  } else if (strcmp(req, "T")==0) {
-    return TOKEN;
-  } else if (strcmp(req, "X")==0) {
-    return REGISTER_RESPONSE;
-  } else {
-    return UNKNOWN;
-  }
-
-}
@@ -43,6 +43,10 @@
 #define SC_GetMV        22
 #define SC_SetMV        23
 #define SC_CreateMV     24
+#define SC_Mmap         25
+#define SC_Munmap       26
+#define SC_GetMVs       27
+#define SC_SetMVs       28
 
 #define MAXFILENAME 256
 
@@ -124,6 +128,17 @@ int Read(char *buffer, int size, OpenFileId id);
 /* Close the file, we're done reading and writing to it. */
 void Close(OpenFileId id);
 
+/* Map the first "size" bytes of the open file into the address space,
+ * and return the address they start at (or -1).  Pages are read from
+ * the file as they are touched, and changes are written back to it
+ * when the pages are evicted or unmapped.  The file can't be closed
+ * while it is mapped.
+ */
+int Mmap(OpenFileId id, int size);
+
+/* Write back and remove the mapping starting at "addr". */
+void Munmap(int addr);
+
 
 
 /* User-level thread operations: Fork and Yield.  To allow multiple
@@ -180,6 +195,15 @@ void SetMV(int index, int value);
 
 int CreateMV(char* buf);
 
+/* Get the values of the "count" MVs whose ids are in "ids" into
+ * "values", or set them from "values".  The requests go to the server
+ * together, rather than one round trip per MV.  Return "count", or -1
+ * if the arrays are bad.
+ */
+int GetMVs(int *ids, int *values, int count);
+
+int SetMVs(int *ids, int *values, int count);
+
 
 #endif /* IN_ASM */
 
@@ -18,6 +18,8 @@
 #include "copyright.h"
 #include "utility.h"
 
+class AddrSpace;
+
 // The following class defines an entry in a translation table -- either
 // in a page table or a TLB.  Each entry defines a mapping from one 
 // virtual page to one physical page.
@@ -42,4 +44,10 @@ class NewTranslationEntry {
 			// page is referenced or modified.
     bool dirty;         // This bit is set by the hardware every time the
 			// page is modified.
+    AddrSpace *space;	// The address space the page belongs to.
+    int lastUseSample;	// Last working set sample the page was
+			// found to have been used in.
+    int pinned;		// Number of kernel transfers going on to or
+			// from the frame; it can't be evicted until
+			// they are done.
 };